@@ -162,6 +162,7 @@ static int fbdbi_driver_probe_spi(struct spi_device *spi)
 	struct mipi_dbi_config mipicfg = {
 		.xres = 176,
 		.yres = 220,
+		.gram_height = 220,
 		.addr_mode0 = 0,
 		.addr_mode90 = HX8340_MADCTL_MV | HX8340_MADCTL_MY,
 		.addr_mode180 = HX8340_MADCTL_MX | HX8340_MADCTL_MY,
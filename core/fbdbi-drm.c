@@ -0,0 +1,705 @@
+/*
+ * DRM driver for fbdbi displays
+ *
+ * Copyright 2015 Noralf Tronnes
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * The display is set up by devm_fbdbi_init() like the fbdev driver, but
+ * the framebuffer is never registered. fb_info only carries the mode and
+ * rotation the controller code expects.
+ *
+ * One atomic plane/crtc/encoder/connector chain drives the panel. Flushes
+ * run synchronously and are sent straight from the DRM framebuffer: a new
+ * framebuffer on the plane is sent in full, and the clips passed to
+ * DRM_IOCTL_MODE_DIRTYFB go through the same damage list merging as fbdev
+ * damage. The page flip event is sent when the flush is done, so it tells
+ * userspace the frame is on the panel.
+ */
+
+#include <linux/dma-buf.h>
+#include <linux/module.h>
+#include <linux/of.h>
+
+#include <drm/drmP.h>
+#include <drm/drm_atomic_helper.h>
+#include <drm/drm_crtc.h>
+#include <drm/drm_crtc_helper.h>
+#include <drm/drm_gem_cma_helper.h>
+#include <drm/drm_plane_helper.h>
+
+#include "fbdbi.h"
+
+struct fbdbi_drm {
+	struct drm_device *drm;
+	struct drm_plane plane;
+	struct drm_crtc crtc;
+	struct drm_encoder encoder;
+	struct drm_connector connector;
+	struct drm_display_mode mode;
+	struct fbdbi_display *display;
+	u32 format;
+	bool enabled;
+};
+
+struct fbdbi_drm_fb {
+	struct drm_framebuffer base;
+	struct drm_gem_cma_object *obj;
+};
+
+static inline struct fbdbi_drm_fb *to_fbdbi_drm_fb(struct drm_framebuffer *fb)
+{
+	return container_of(fb, struct fbdbi_drm_fb, base);
+}
+
+static u32 fbdbi_drm_format(enum fbdbi_format format)
+{
+	switch (format) {
+	case FBDBI_FORMAT_RGB565:
+		return DRM_FORMAT_RGB565;
+	case FBDBI_FORMAT_RGB888:
+		return DRM_FORMAT_RGB888;
+	case FBDBI_FORMAT_XRGB8888:
+		return DRM_FORMAT_XRGB8888;
+	default:
+		return 0;
+	}
+}
+
+/* Send the damaged rectangles from the DRM framebuffer */
+static int fbdbi_drm_flush(struct fbdbi_drm *fdrm, struct drm_framebuffer *fb,
+			   struct fbdbi_damage *damage)
+{
+	struct fbdbi_display *display = fdrm->display;
+	struct fbdbi *fbdbi = display->info->par;
+	struct drm_gem_cma_object *cma_obj = to_fbdbi_drm_fb(fb)->obj;
+	struct dma_buf_attachment *import_attach = cma_obj->base.import_attach;
+	void *vaddr = cma_obj->vaddr;
+	struct fbdbi_rect *rect;
+	int i, ret = 0;
+
+	pr_debug("%s(num=%u)\n", __func__, damage->num);
+
+	/* PRIME buffers are contiguous, but only mapped for the device */
+	if (import_attach) {
+		ret = dma_buf_begin_cpu_access(import_attach->dmabuf, 0,
+					       import_attach->dmabuf->size,
+					       DMA_FROM_DEVICE);
+		if (ret)
+			return ret;
+		vaddr = dma_buf_vmap(import_attach->dmabuf);
+		if (!vaddr) {
+			ret = -ENOMEM;
+			goto out_end_access;
+		}
+	}
+
+	fbdbi->scanout = vaddr + fb->offsets[0];
+	fbdbi->scanout_dma = cma_obj->paddr + fb->offsets[0];
+	for (i = 0; i < damage->num && !ret; i++) {
+		rect = &damage->rects[i];
+		ret = display->update(display, rect->xs, rect->xe,
+				      rect->ys, rect->ye);
+	}
+	fbdbi->scanout = NULL;
+	fbdbi->scanout_dma = 0;
+
+	if (import_attach)
+		dma_buf_vunmap(import_attach->dmabuf, vaddr);
+out_end_access:
+	if (import_attach)
+		dma_buf_end_cpu_access(import_attach->dmabuf, 0,
+				       import_attach->dmabuf->size,
+				       DMA_FROM_DEVICE);
+
+	return ret;
+}
+
+static int fbdbi_drm_flush_full(struct fbdbi_drm *fdrm,
+				struct drm_framebuffer *fb)
+{
+	struct fbdbi_damage damage = {
+		.rects[0] = {
+			.xe = fdrm->mode.hdisplay - 1,
+			.ye = fdrm->mode.vdisplay - 1,
+		},
+		.num = 1,
+	};
+
+	return fbdbi_drm_flush(fdrm, fb, &damage);
+}
+
+static void fbdbi_drm_fb_destroy(struct drm_framebuffer *fb)
+{
+	struct fbdbi_drm_fb *dfb = to_fbdbi_drm_fb(fb);
+
+	drm_framebuffer_cleanup(fb);
+	drm_gem_object_unreference_unlocked(&dfb->obj->base);
+	kfree(dfb);
+}
+
+static int fbdbi_drm_fb_create_handle(struct drm_framebuffer *fb,
+				      struct drm_file *file_priv,
+				      unsigned int *handle)
+{
+	return drm_gem_handle_create(file_priv, &to_fbdbi_drm_fb(fb)->obj->base,
+				     handle);
+}
+
+/*
+ * DRM_IOCTL_MODE_DIRTYFB. The clips are merged where sending the bounding
+ * box is cheaper, like fbdev damage, see fbdbi_damage_add().
+ */
+static int fbdbi_drm_fb_dirty(struct drm_framebuffer *fb,
+			      struct drm_file *file_priv, unsigned flags,
+			      unsigned color, struct drm_clip_rect *clips,
+			      unsigned num_clips)
+{
+	struct fbdbi_drm *fdrm = fb->dev->dev_private;
+	struct fbdbi_damage damage;
+	struct fbdbi_rect *rects;
+	unsigned i, n = 0, inc = 1;
+	int ret = 0;
+
+	/* copy source and destination come in pairs */
+	if (flags & DRM_MODE_FB_DIRTY_ANNOTATE_COPY) {
+		num_clips /= 2;
+		inc = 2;
+	}
+
+	rects = kmalloc_array(num_clips ? : 1, sizeof(*rects), GFP_KERNEL);
+	if (!rects)
+		return -ENOMEM;
+
+	for (i = 0; i < num_clips; i++) {
+		struct drm_clip_rect *clip = &clips[i * inc];
+
+		if (clip->x1 >= clip->x2 || clip->y1 >= clip->y2)
+			continue;
+		rects[n].xs = clip->x1;
+		rects[n].xe = clip->x2 - 1;
+		rects[n].ys = clip->y1;
+		rects[n].ye = clip->y2 - 1;
+		n++;
+	}
+
+	drm_modeset_lock_all(fb->dev);
+
+	if (!fdrm->enabled || fdrm->plane.state->fb != fb)
+		goto out_unlock;
+
+	if (!num_clips) {
+		ret = fbdbi_drm_flush_full(fdrm, fb);
+		goto out_unlock;
+	}
+
+	fbdbi_damage_from_rects(fdrm->display->info, &damage, rects, n);
+	if (damage.num)
+		ret = fbdbi_drm_flush(fdrm, fb, &damage);
+
+out_unlock:
+	drm_modeset_unlock_all(fb->dev);
+	kfree(rects);
+
+	return ret;
+}
+
+static const struct drm_framebuffer_funcs fbdbi_drm_fb_funcs = {
+	.destroy = fbdbi_drm_fb_destroy,
+	.create_handle = fbdbi_drm_fb_create_handle,
+	.dirty = fbdbi_drm_fb_dirty,
+};
+
+static struct drm_framebuffer *
+fbdbi_drm_fb_create(struct drm_device *drm, struct drm_file *file_priv,
+		    struct drm_mode_fb_cmd2 *mode_cmd)
+{
+	struct fbdbi_drm *fdrm = drm->dev_private;
+	struct drm_gem_object *obj;
+	struct fbdbi_drm_fb *dfb;
+	int ret;
+
+	if (mode_cmd->pixel_format != fdrm->format)
+		return ERR_PTR(-EINVAL);
+
+	obj = drm_gem_object_lookup(drm, file_priv, mode_cmd->handles[0]);
+	if (!obj)
+		return ERR_PTR(-ENOENT);
+
+	if (obj->size < (size_t)mode_cmd->pitches[0] * mode_cmd->height +
+			mode_cmd->offsets[0]) {
+		ret = -EINVAL;
+		goto err_unref;
+	}
+
+	dfb = kzalloc(sizeof(*dfb), GFP_KERNEL);
+	if (!dfb) {
+		ret = -ENOMEM;
+		goto err_unref;
+	}
+
+	dfb->obj = to_drm_gem_cma_obj(obj);
+	drm_helper_mode_fill_fb_struct(&dfb->base, mode_cmd);
+	ret = drm_framebuffer_init(drm, &dfb->base, &fbdbi_drm_fb_funcs);
+	if (ret) {
+		kfree(dfb);
+		goto err_unref;
+	}
+
+	return &dfb->base;
+
+err_unref:
+	drm_gem_object_unreference_unlocked(obj);
+
+	return ERR_PTR(ret);
+}
+
+static int fbdbi_drm_plane_atomic_check(struct drm_plane *plane,
+					struct drm_plane_state *state)
+{
+	struct fbdbi_drm *fdrm = plane->dev->dev_private;
+	struct drm_framebuffer *fb = state->fb;
+
+	if (!fb)
+		return 0;
+
+	/* no scaling, and fbdbi_display_update() walks the fbdev stride */
+	if (state->crtc_x || state->crtc_y ||
+	    state->crtc_w != fdrm->mode.hdisplay ||
+	    state->crtc_h != fdrm->mode.vdisplay ||
+	    state->src_x || state->src_y ||
+	    state->src_w != state->crtc_w << 16 ||
+	    state->src_h != state->crtc_h << 16 ||
+	    fb->pitches[0] != fdrm->display->info->fix.line_length)
+		return -EINVAL;
+
+	return 0;
+}
+
+/* A new framebuffer is sent in full, later changes come through dirty */
+static void fbdbi_drm_plane_atomic_update(struct drm_plane *plane,
+					  struct drm_plane_state *old_state)
+{
+	struct fbdbi_drm *fdrm = plane->dev->dev_private;
+	struct drm_framebuffer *fb = plane->state->fb;
+
+	if (fdrm->enabled && fb && fb != old_state->fb)
+		fbdbi_drm_flush_full(fdrm, fb);
+}
+
+static const struct drm_plane_helper_funcs fbdbi_drm_plane_helper_funcs = {
+	.atomic_check = fbdbi_drm_plane_atomic_check,
+	.atomic_update = fbdbi_drm_plane_atomic_update,
+};
+
+static const struct drm_plane_funcs fbdbi_drm_plane_funcs = {
+	.update_plane = drm_atomic_helper_update_plane,
+	.disable_plane = drm_atomic_helper_disable_plane,
+	.destroy = drm_plane_cleanup,
+	.reset = drm_atomic_helper_plane_reset,
+	.atomic_duplicate_state = drm_atomic_helper_plane_duplicate_state,
+	.atomic_destroy_state = drm_atomic_helper_plane_destroy_state,
+};
+
+static void fbdbi_drm_crtc_enable(struct drm_crtc *crtc)
+{
+	struct fbdbi_drm *fdrm = crtc->dev->dev_private;
+	struct drm_framebuffer *fb = fdrm->plane.state->fb;
+
+	fdrm->enabled = true;
+	if (fb)
+		fbdbi_drm_flush_full(fdrm, fb);
+}
+
+static void fbdbi_drm_crtc_disable(struct drm_crtc *crtc)
+{
+	struct fbdbi_drm *fdrm = crtc->dev->dev_private;
+
+	fdrm->enabled = false;
+}
+
+/* Runs after the plane update, so the frame is already on the panel */
+static void fbdbi_drm_crtc_atomic_flush(struct drm_crtc *crtc,
+					struct drm_crtc_state *old_state)
+{
+	struct drm_pending_vblank_event *event = crtc->state->event;
+	unsigned long flags;
+
+	if (!event)
+		return;
+
+	crtc->state->event = NULL;
+	spin_lock_irqsave(&crtc->dev->event_lock, flags);
+	drm_crtc_send_vblank_event(crtc, event);
+	spin_unlock_irqrestore(&crtc->dev->event_lock, flags);
+}
+
+static const struct drm_crtc_helper_funcs fbdbi_drm_crtc_helper_funcs = {
+	.enable = fbdbi_drm_crtc_enable,
+	.disable = fbdbi_drm_crtc_disable,
+	.atomic_flush = fbdbi_drm_crtc_atomic_flush,
+};
+
+static const struct drm_crtc_funcs fbdbi_drm_crtc_funcs = {
+	.reset = drm_atomic_helper_crtc_reset,
+	.destroy = drm_crtc_cleanup,
+	.set_config = drm_atomic_helper_set_config,
+	.page_flip = drm_atomic_helper_page_flip,
+	.atomic_duplicate_state = drm_atomic_helper_crtc_duplicate_state,
+	.atomic_destroy_state = drm_atomic_helper_crtc_destroy_state,
+};
+
+/* Enabled after the crtc has sent the first frame */
+static void fbdbi_drm_encoder_enable(struct drm_encoder *encoder)
+{
+	struct fbdbi_drm *fdrm = encoder->dev->dev_private;
+	struct fbdbi_display *display = fdrm->display;
+
+	if (display->blank) {
+		lcdreg_lock(display->lcdreg);
+		display->blank(display, false);
+		lcdreg_unlock(display->lcdreg);
+	}
+	if (display->backlight) {
+		display->backlight->props.power = FB_BLANK_UNBLANK;
+		backlight_update_status(display->backlight);
+	}
+}
+
+static void fbdbi_drm_encoder_disable(struct drm_encoder *encoder)
+{
+	struct fbdbi_drm *fdrm = encoder->dev->dev_private;
+	struct fbdbi_display *display = fdrm->display;
+
+	if (display->backlight) {
+		display->backlight->props.power = FB_BLANK_POWERDOWN;
+		backlight_update_status(display->backlight);
+	}
+	if (display->blank) {
+		lcdreg_lock(display->lcdreg);
+		display->blank(display, true);
+		lcdreg_unlock(display->lcdreg);
+	}
+}
+
+static const struct drm_encoder_helper_funcs fbdbi_drm_encoder_helper_funcs = {
+	.enable = fbdbi_drm_encoder_enable,
+	.disable = fbdbi_drm_encoder_disable,
+};
+
+static const struct drm_encoder_funcs fbdbi_drm_encoder_funcs = {
+	.destroy = drm_encoder_cleanup,
+};
+
+static int fbdbi_drm_connector_get_modes(struct drm_connector *connector)
+{
+	struct fbdbi_drm *fdrm = connector->dev->dev_private;
+	struct drm_display_mode *mode;
+
+	mode = drm_mode_duplicate(connector->dev, &fdrm->mode);
+	if (!mode)
+		return 0;
+
+	drm_mode_probed_add(connector, mode);
+
+	return 1;
+}
+
+static struct drm_encoder *
+fbdbi_drm_connector_best_encoder(struct drm_connector *connector)
+{
+	struct fbdbi_drm *fdrm = connector->dev->dev_private;
+
+	return &fdrm->encoder;
+}
+
+static const struct drm_connector_helper_funcs fbdbi_drm_connector_helper_funcs = {
+	.get_modes = fbdbi_drm_connector_get_modes,
+	.best_encoder = fbdbi_drm_connector_best_encoder,
+};
+
+static enum drm_connector_status
+fbdbi_drm_connector_detect(struct drm_connector *connector, bool force)
+{
+	return connector_status_connected;
+}
+
+static const struct drm_connector_funcs fbdbi_drm_connector_funcs = {
+	.dpms = drm_atomic_helper_connector_dpms,
+	.reset = drm_atomic_helper_connector_reset,
+	.detect = fbdbi_drm_connector_detect,
+	.fill_modes = drm_helper_probe_single_connector_modes,
+	.destroy = drm_connector_cleanup,
+	.atomic_duplicate_state = drm_atomic_helper_connector_duplicate_state,
+	.atomic_destroy_state = drm_atomic_helper_connector_destroy_state,
+};
+
+/*
+ * drm_atomic_helper_commit() refuses async commits, which the legacy page
+ * flip uses. The flush is synchronous anyway, so async commits run like
+ * blocking ones and the flip event is sent when the frame is on the panel.
+ */
+static int fbdbi_drm_atomic_commit(struct drm_device *drm,
+				   struct drm_atomic_state *state, bool async)
+{
+	return drm_atomic_helper_commit(drm, state, false);
+}
+
+static const struct drm_mode_config_funcs fbdbi_drm_mode_config_funcs = {
+	.fb_create = fbdbi_drm_fb_create,
+	.atomic_check = drm_atomic_helper_check,
+	.atomic_commit = fbdbi_drm_atomic_commit,
+};
+
+static const struct file_operations fbdbi_drm_fops = {
+	.owner = THIS_MODULE,
+	.open = drm_open,
+	.release = drm_release,
+	.unlocked_ioctl = drm_ioctl,
+#ifdef CONFIG_COMPAT
+	.compat_ioctl = drm_compat_ioctl,
+#endif
+	.poll = drm_poll,
+	.read = drm_read,
+	.llseek = no_llseek,
+	.mmap = drm_gem_cma_mmap,
+};
+
+static struct drm_driver fbdbi_drm_driver = {
+	.driver_features = DRIVER_GEM | DRIVER_MODESET | DRIVER_PRIME |
+			   DRIVER_ATOMIC,
+	.fops = &fbdbi_drm_fops,
+	.gem_free_object = drm_gem_cma_free_object,
+	.gem_vm_ops = &drm_gem_cma_vm_ops,
+	.prime_handle_to_fd = drm_gem_prime_handle_to_fd,
+	.prime_fd_to_handle = drm_gem_prime_fd_to_handle,
+	.gem_prime_import = drm_gem_prime_import,
+	.gem_prime_export = drm_gem_prime_export,
+	.gem_prime_import_sg_table = drm_gem_cma_prime_import_sg_table,
+	.gem_prime_get_sg_table = drm_gem_cma_prime_get_sg_table,
+	.gem_prime_vmap = drm_gem_cma_prime_vmap,
+	.gem_prime_vunmap = drm_gem_cma_prime_vunmap,
+	.gem_prime_mmap = drm_gem_cma_prime_mmap,
+	.dumb_create = drm_gem_cma_dumb_create,
+	.dumb_map_offset = drm_gem_cma_dumb_map_offset,
+	.dumb_destroy = drm_gem_dumb_destroy,
+	.name = "fbdbi",
+	.desc = "fbdbi displays",
+	.date = "20150101",
+	.major = 1,
+	.minor = 0,
+};
+
+/* Mirrors fbdbi_fb_destroy() for the parts the DRM side uses */
+static void fbdbi_drm_release(void *data)
+{
+	struct fbdbi_drm *fdrm = data;
+	struct fbdbi_display *display = fdrm->display;
+	struct fbdbi *fbdbi = display->info->par;
+
+	drm_connector_unregister(&fdrm->connector);
+	drm_dev_unregister(fdrm->drm);
+	if (fdrm->enabled)
+		fbdbi_drm_encoder_disable(&fdrm->encoder);
+	drm_mode_config_cleanup(fdrm->drm);
+	drm_dev_unref(fdrm->drm);
+
+	vfree(fbdbi->txbuf);
+	fbdbi->txbuf = NULL;
+	if (display->poweroff)
+		display->poweroff(display);
+}
+
+/* Power on and rotate the controller, fbdev does this in devm_fbdbi_register() */
+static int fbdbi_drm_display_init(struct fbdbi_display *display)
+{
+	struct fb_info *info = display->info;
+	int ret;
+
+	if (display->poweron) {
+		ret = display->poweron(display);
+		if (ret)
+			return ret;
+	}
+
+	if (display->set_format) {
+		ret = display->set_format(display);
+		if (ret)
+			return ret;
+	}
+
+	/* software rotation works on fbdev video memory */
+	if (!display->rotate)
+		return info->var.rotate ? -EINVAL : 0;
+
+	/* also in rotation 0, the controller sets its address mode here */
+	ret = info->fbops->fb_check_var(&info->var, info);
+	if (ret)
+		return ret;
+
+	return info->fbops->fb_set_par(info);
+}
+
+static int fbdbi_drm_modeset_init(struct fbdbi_drm *fdrm)
+{
+	struct drm_device *drm = fdrm->drm;
+	struct fb_info *info = fdrm->display->info;
+	int ret;
+
+	drm_mode_config_init(drm);
+	drm->mode_config.min_width = info->var.xres;
+	drm->mode_config.max_width = info->var.xres;
+	drm->mode_config.min_height = info->var.yres;
+	drm->mode_config.max_height = info->var.yres;
+	drm->mode_config.preferred_depth = info->var.bits_per_pixel == 16 ?
+					   16 : 24;
+	drm->mode_config.funcs = &fbdbi_drm_mode_config_funcs;
+
+	drm_plane_helper_add(&fdrm->plane, &fbdbi_drm_plane_helper_funcs);
+	ret = drm_universal_plane_init(drm, &fdrm->plane, 0,
+				       &fbdbi_drm_plane_funcs, &fdrm->format, 1,
+				       DRM_PLANE_TYPE_PRIMARY);
+	if (ret)
+		return ret;
+
+	drm_crtc_helper_add(&fdrm->crtc, &fbdbi_drm_crtc_helper_funcs);
+	ret = drm_crtc_init_with_planes(drm, &fdrm->crtc, &fdrm->plane, NULL,
+					&fbdbi_drm_crtc_funcs);
+	if (ret)
+		return ret;
+
+	drm_encoder_helper_add(&fdrm->encoder, &fbdbi_drm_encoder_helper_funcs);
+	fdrm->encoder.possible_crtcs = 1 << drm_crtc_index(&fdrm->crtc);
+	ret = drm_encoder_init(drm, &fdrm->encoder, &fbdbi_drm_encoder_funcs,
+			       DRM_MODE_ENCODER_NONE);
+	if (ret)
+		return ret;
+
+	drm_connector_helper_add(&fdrm->connector,
+				 &fbdbi_drm_connector_helper_funcs);
+	ret = drm_connector_init(drm, &fdrm->connector,
+				 &fbdbi_drm_connector_funcs,
+				 DRM_MODE_CONNECTOR_VIRTUAL);
+	if (ret)
+		return ret;
+
+	ret = drm_mode_connector_attach_encoder(&fdrm->connector,
+						&fdrm->encoder);
+	if (ret)
+		return ret;
+
+	drm_mode_config_reset(drm);
+
+	return 0;
+}
+
+int devm_fbdbi_drm_register_dt(struct device *dev, struct fbdbi_display *display)
+{
+	struct device_node *backlight;
+	struct drm_device *drm;
+	struct fbdbi_drm *fdrm;
+	struct fb_info *info;
+	int ret;
+
+	fdrm = devm_kzalloc(dev, sizeof(*fdrm), GFP_KERNEL);
+	if (!fdrm)
+		return -ENOMEM;
+
+	fdrm->format = fbdbi_drm_format(display->format);
+	if (!fdrm->format) {
+		dev_err(dev, "format not supported by fbdbi-drm\n");
+		return -EINVAL;
+	}
+
+	/* the DRM framebuffer is scanned out, fbdev video memory is unused */
+	display->buffers = 1;
+	display->dma_vmem = false;
+	display->lazy_vmem = true;
+	display->sw_rotate = false;
+
+	ret = devm_fbdbi_init(dev, display);
+	if (ret)
+		return ret;
+
+	info = display->info;
+	info->var.rotate = fbdbi_of_value(dev, "rotate", 0);
+	display->initialized = of_property_read_bool(dev->of_node,
+						     "initialized");
+
+	display->power_supply = devm_regulator_get(dev, "power");
+	if (IS_ERR(display->power_supply))
+		return PTR_ERR(display->power_supply);
+
+	backlight = of_parse_phandle(dev->of_node, "backlight", 0);
+	if (backlight) {
+		display->backlight = of_find_backlight_by_node(backlight);
+		of_node_put(backlight);
+
+		if (!display->backlight)
+			return -EPROBE_DEFER;
+	}
+
+	if (!display->initialized) {
+		ret = fbdbi_drm_display_init(display);
+		if (ret)
+			return ret;
+	}
+
+	fdrm->display = display;
+	fdrm->mode.hdisplay = info->var.xres;
+	fdrm->mode.hsync_start = info->var.xres;
+	fdrm->mode.hsync_end = info->var.xres;
+	fdrm->mode.htotal = info->var.xres;
+	fdrm->mode.vdisplay = info->var.yres;
+	fdrm->mode.vsync_start = info->var.yres;
+	fdrm->mode.vsync_end = info->var.yres;
+	fdrm->mode.vtotal = info->var.yres;
+	fdrm->mode.type = DRM_MODE_TYPE_DRIVER | DRM_MODE_TYPE_PREFERRED;
+	drm_mode_set_name(&fdrm->mode);
+
+	drm = drm_dev_alloc(&fbdbi_drm_driver, dev);
+	if (!drm)
+		return -ENOMEM;
+
+	fdrm->drm = drm;
+	drm->dev_private = fdrm;
+
+	ret = fbdbi_drm_modeset_init(fdrm);
+	if (ret)
+		goto err_cleanup;
+
+	ret = drm_dev_register(drm, 0);
+	if (ret)
+		goto err_cleanup;
+
+	ret = drm_connector_register(&fdrm->connector);
+	if (ret) {
+		drm_dev_unregister(drm);
+		goto err_cleanup;
+	}
+
+	ret = devm_add_action(dev, fbdbi_drm_release, fdrm);
+	if (ret) {
+		fbdbi_drm_release(fdrm);
+		return ret;
+	}
+
+	dev_info(dev, "%s DRM display, %dx%d\n", dev->driver->name,
+		 info->var.xres, info->var.yres);
+
+	return 0;
+
+err_cleanup:
+	drm_mode_config_cleanup(drm);
+	drm_dev_unref(drm);
+
+	return ret;
+}
+EXPORT_SYMBOL(devm_fbdbi_drm_register_dt);
+
+MODULE_LICENSE("GPL");
@@ -0,0 +1,104 @@
+/*
+ * fbdbi driver specific ioctls
+ *
+ * This header is shared with userspace.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#ifndef __LINUX_FBDBI_IOCTL_H
+#define __LINUX_FBDBI_IOCTL_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/*
+ * Damage rectangle in virtual screen coordinates.
+ * x1,y1 is inclusive, x2,y2 is exclusive (same as drm_clip_rect).
+ */
+struct fbdbi_clip_rect {
+	__u16 x1;
+	__u16 y1;
+	__u16 x2;
+	__u16 y2;
+};
+
+#define FBDBI_DIRTY_MAX_CLIPS	256
+
+/*
+ * @clips_ptr: pointer to an array of struct fbdbi_clip_rect
+ * @num_clips: number of rectangles, 0 marks the whole screen dirty
+ * @flags: must be zero
+ */
+struct fbdbi_dirty {
+	__u64 clips_ptr;
+	__u32 num_clips;
+	__u32 flags;
+};
+
+/*
+ * Page fault tracking of writes to mmap'ed memory.
+ * When turned off, mmaps made afterwards are not tracked and the client
+ * must report its damage with FBDBI_IOCTL_DIRTY. Existing mappings are
+ * not affected.
+ */
+#define FBDBI_TRACKING_OFF	0
+#define FBDBI_TRACKING_ON	1
+
+/*
+ * Each flush to the panel has a sequence number, starting at 1.
+ * @seq: in: wait until this flush has completed, 0 waits for the pending
+ *           flush if there is one
+ *       out: last completed flush
+ * @timestamp_ns: out: CLOCK_MONOTONIC time when flush @seq completed
+ * @timeout_ms: in: 0 means 1 second
+ *
+ * The same information is available in the flush_seq sysfs attribute of
+ * the fb device as "<seq> <timestamp_ns>". The attribute can be poll()'ed
+ * (POLLPRI) for flush completion.
+ */
+struct fbdbi_wait_flush {
+	__u64 seq;
+	__s64 timestamp_ns;
+	__u32 timeout_ms;
+	__u32 pad;
+};
+
+/*
+ * Overlay plane on top of the framebuffer, blended in when the panel is
+ * updated. Changing the overlay only sends the overlay area.
+ * Not available for formats below 16 bpp or with software rotation.
+ * @data_ptr: width * height pixels in the framebuffer format,
+ *            0 keeps the current pixels (position change only)
+ * @x, @y, @width, @height: position and size on screen, in video memory
+ *                          lines when the console uses ywrap scrolling
+ * @flags: FBDBI_OVERLAY_*, without FBDBI_OVERLAY_ENABLE the overlay is
+ *         removed
+ * @colorkey: overlay pixels with this value are transparent
+ * @alpha: global overlay opacity, 0-255
+ */
+#define FBDBI_OVERLAY_ENABLE	(1 << 0)
+#define FBDBI_OVERLAY_COLORKEY	(1 << 1)
+#define FBDBI_OVERLAY_ALPHA	(1 << 2)
+
+struct fbdbi_overlay {
+	__u64 data_ptr;
+	__u16 x;
+	__u16 y;
+	__u16 width;
+	__u16 height;
+	__u32 flags;
+	__u32 colorkey;
+	__u32 alpha;
+	__u32 pad;
+};
+
+#define FBDBI_IOCTL_DIRTY		_IOW('F', 0xd0, struct fbdbi_dirty)
+#define FBDBI_IOCTL_SET_TRACKING	_IOW('F', 0xd1, __u32)
+#define FBDBI_IOCTL_WAIT_FLUSH		_IOWR('F', 0xd2, struct fbdbi_wait_flush)
+#define FBDBI_IOCTL_SET_OVERLAY		_IOW('F', 0xd3, struct fbdbi_overlay)
+
+#endif /* __LINUX_FBDBI_IOCTL_H */
@@ -1,13 +1,24 @@
 //#define DEBUG
 // included in fbdbi.h : backlight, fb, spinlock
 
+#include <linux/debugfs.h>
 #include <linux/device.h>
+#include <linux/dma-mapping.h>
+#include <linux/interrupt.h>
+#include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/pagemap.h>
 #include <linux/platform_device.h>
 #include <linux/regulator/consumer.h>
+#include <linux/rmap.h>
+#include <linux/seq_file.h>
+#include <linux/videodev2.h>
 #include <linux/vmalloc.h>
 
 #include "fbdbi.h"
+#include "fbdbi-ioctl.h"
+
+static struct dentry *fbdbi_debugfs_root;
 
 /*
 devm_vzalloc is located here temporarily
@@ -168,12 +179,13 @@ u32 fbdbi_of_value(struct device *dev, const char *propname, u32 def_value)
 }
 EXPORT_SYMBOL(fbdbi_of_value);
 
-u32 fbdbi_of_format(struct device *dev, enum fbdbi_format def_format)
+static u32 fbdbi_of_format_prop(struct device *dev, const char *propname,
+				enum fbdbi_format def_format)
 {
 	const char *fmt_str;
 	int ret;
 
-	ret = of_property_read_string(dev->of_node, "format", &fmt_str);
+	ret = of_property_read_string(dev->of_node, propname, &fmt_str);
 	if (ret)
 		return def_format;
 
@@ -187,320 +199,2381 @@ u32 fbdbi_of_format(struct device *dev, enum fbdbi_format def_format)
 		return FBDBI_FORMAT_RGB888;
 	if (!strcmp(fmt_str, "xrgb8888"))
 		return FBDBI_FORMAT_XRGB8888;
+	if (!strcmp(fmt_str, "c8"))
+		return FBDBI_FORMAT_C8;
+	if (!strcmp(fmt_str, "i420"))
+		return FBDBI_FORMAT_I420;
+	if (!strcmp(fmt_str, "nv12"))
+		return FBDBI_FORMAT_NV12;
 
-	dev_err(dev, "Invalid format: %s. Using default.\n", fmt_str);
+	dev_err(dev, "Invalid %s: %s. Using default.\n", propname, fmt_str);
 
 	return def_format;
 }
+
+u32 fbdbi_of_format(struct device *dev, enum fbdbi_format def_format)
+{
+	return fbdbi_of_format_prop(dev, "format", def_format);
+}
 EXPORT_SYMBOL(fbdbi_of_format);
 
-static void fbdbi_deferred_io(struct fb_info *info, struct list_head *pagelist)
+static const char * const fbdbi_sched_names[] = {
+	[FBDBI_SCHED_AUTO] = "auto",
+	[FBDBI_SCHED_ONESHOT] = "oneshot",
+	[FBDBI_SCHED_DEFERRED] = "deferred",
+	[FBDBI_SCHED_FIXED] = "fixed",
+	[FBDBI_SCHED_CONTINUOUS] = "continuous",
+	[FBDBI_SCHED_THROTTLE] = "throttle",
+};
+
+static int fbdbi_sched_parse(const char *str)
 {
-	struct fbdbi *fbdbi = info->par;
-	struct fbdbi_display *display = fbdbi->display;
-	unsigned dirty_lines_start, dirty_lines_end;
-	struct page *page;
-	unsigned long index;
-	unsigned y_low = 0, y_high = 0;
-	int count = 0;
-
-	spin_lock(&fbdbi->dirty_lock);
-	dirty_lines_start = fbdbi->dirty_lines_start;
-	dirty_lines_end = fbdbi->dirty_lines_end;
-	/* set display line markers as clean */
-	fbdbi->dirty_lines_start = display->info->var.yres - 1;
-	fbdbi->dirty_lines_end = 0;
-	spin_unlock(&fbdbi->dirty_lock);
-
-	/* Mark display lines as dirty */
-	list_for_each_entry(page, pagelist, lru) {
-		count++;
-		index = page->index << PAGE_SHIFT;
-		y_low = index / info->fix.line_length;
-		y_high = (index + PAGE_SIZE - 1) / info->fix.line_length;
-		if (y_high > info->var.yres - 1)
-			y_high = info->var.yres - 1;
-		if (y_low < dirty_lines_start)
-			dirty_lines_start = y_low;
-		if (y_high > dirty_lines_end)
-			dirty_lines_end = y_high;
-	}
+	int i;
 
-	display->update(display, dirty_lines_start, dirty_lines_end);
-	// notify error?
+	for (i = 0; i < ARRAY_SIZE(fbdbi_sched_names); i++)
+		if (sysfs_streq(str, fbdbi_sched_names[i]))
+			return i;
+
+	return -EINVAL;
 }
 
+enum fbdbi_sched fbdbi_of_sched(struct device *dev, enum fbdbi_sched def_sched)
+{
+	const char *sched_str;
+	int ret;
 
+	ret = of_property_read_string(dev->of_node, "sched", &sched_str);
+	if (ret)
+		return def_sched;
 
+	dev_dbg(dev, "%s: sched = %s\n", __func__, sched_str);
 
-static void fbdbi_mkdirty(struct fb_info *info, int y, int height)
-{
-	struct fbdbi *fbdbi = info->par;
-	struct fb_deferred_io *fbdefio = info->fbdefio;
+	ret = fbdbi_sched_parse(sched_str);
+	if (ret < 0) {
+		dev_err(dev, "Invalid sched: %s. Using default.\n", sched_str);
+		return def_sched;
+	}
 
-	/* Mark the specified display lines/area as dirty */
-	spin_lock(&fbdbi->dirty_lock);
-	if (y < fbdbi->dirty_lines_start)
-		fbdbi->dirty_lines_start = y;
-	if (y + height - 1 > fbdbi->dirty_lines_end)
-		fbdbi->dirty_lines_end = y + height - 1;
-	spin_unlock(&fbdbi->dirty_lock);
+	return ret;
+}
+EXPORT_SYMBOL(fbdbi_of_sched);
 
-	/* Schedule deferred_io to update display (no-op if already on queue)*/
-	schedule_delayed_work(&info->deferred_work, fbdefio->delay);
+static void fbdbi_rect_merge(struct fbdbi_rect *dst, const struct fbdbi_rect *src)
+{
+	dst->xs = min(dst->xs, src->xs);
+	dst->xe = max(dst->xe, src->xe);
+	dst->ys = min(dst->ys, src->ys);
+	dst->ye = max(dst->ye, src->ye);
 }
 
-static void fbdbi_fb_fillrect(struct fb_info *info, const struct fb_fillrect *rect)
+/* does a contain b */
+static bool fbdbi_rect_contains(const struct fbdbi_rect *a, const struct fbdbi_rect *b)
 {
-	sys_fillrect(info, rect);
-	fbdbi_mkdirty(info, rect->dy, rect->height);
+	return a->xs <= b->xs && a->xe >= b->xe &&
+	       a->ys <= b->ys && a->ye >= b->ye;
 }
 
-static void fbdbi_fb_copyarea(struct fb_info *info, const struct fb_copyarea *area)
+static bool fbdbi_rect_intersects(const struct fbdbi_rect *a, const struct fbdbi_rect *b)
 {
-	sys_copyarea(info, area);
-	fbdbi_mkdirty(info, area->dy, area->height);
+	return a->xs <= b->xe && a->xe >= b->xs &&
+	       a->ys <= b->ye && a->ye >= b->ys;
 }
 
-static void fbdbi_fb_imageblit(struct fb_info *info, const struct fb_image *image)
+/*
+ * Cut away the part of rect that is covered by other, if what remains is
+ * still a rectangle. This keeps overlapping damage from being sent twice.
+ */
+static void fbdbi_rect_subtract(struct fbdbi_rect *rect, const struct fbdbi_rect *other)
 {
-	sys_imageblit(info, image);
-	fbdbi_mkdirty(info, image->dy, image->height);
+	if (!fbdbi_rect_intersects(rect, other) ||
+	    fbdbi_rect_contains(other, rect))
+		return;
+
+	if (other->xs <= rect->xs && other->xe >= rect->xe) {
+		if (other->ys <= rect->ys)
+			rect->ys = other->ye + 1;
+		else if (other->ye >= rect->ye)
+			rect->ye = other->ys - 1;
+	} else if (other->ys <= rect->ys && other->ye >= rect->ye) {
+		if (other->xs <= rect->xs)
+			rect->xs = other->xe + 1;
+		else if (other->xe >= rect->xe)
+			rect->xe = other->xs - 1;
+	}
 }
 
-static ssize_t fbdbi_fb_write(struct fb_info *info,
-			const char __user *buf, size_t count, loff_t *ppos)
+/* bytes on the bus to update rect with one update() call */
+static unsigned long fbdbi_rect_cost(struct fb_info *info, const struct fbdbi_rect *rect)
 {
-	ssize_t res;
+	struct fbdbi *fbdbi = info->par;
+	unsigned long pixels = (unsigned long)(rect->xe - rect->xs + 1) *
+					      (rect->ye - rect->ys + 1);
 
-	res = fb_sys_write(info, buf, count, ppos);
-	/* TODO: only mark changed area
-	   update all for now */
-	fbdbi_mkdirty(info, 0, info->var.yres);
+	return fbdbi->display->update_cost +
+	       pixels * info->var.bits_per_pixel / 8;
+}
 
-	return res;
+static void fbdbi_damage_remove(struct fbdbi_damage *damage, unsigned idx)
+{
+	damage->rects[idx] = damage->rects[--damage->num];
 }
 
-static unsigned int chan_to_field(unsigned chan, struct fb_bitfield *bf)
+/* Damage covers all buffers when each one has its own part of GRAM */
+static unsigned fbdbi_damage_lines(struct fb_info *info)
 {
-	chan &= 0xffff;
-	chan >>= 16 - bf->length;
-	return chan << bf->offset;
+	struct fbdbi *fbdbi = info->par;
+
+	return fbdbi->gram_flip ? info->var.yres_virtual : info->var.yres;
 }
 
-static int fbdbi_fb_setcolreg(unsigned regno,
-			       unsigned red, unsigned green, unsigned blue,
-			       unsigned transp, struct fb_info *info)
+/*
+ * Add rect to the damage list.
+ * A rectangle is merged with an existing one if sending the bounding box
+ * is no more expensive than sending both. When the list is full, the
+ * merge that adds the least cost is done.
+ */
+static void fbdbi_damage_add(struct fb_info *info, struct fbdbi_damage *damage,
+			     const struct fbdbi_rect *new)
 {
-	unsigned val;
-	int ret = 1;
+	struct fbdbi *fbdbi = info->par;
+	struct fbdbi_rect rect = *new;
+	struct fbdbi_rect merged;
+	unsigned long cost, best_cost;
+	unsigned i, best;
+
+	if (fbdbi_rect_empty(&rect))
+		return;
+
+	rect.xe = min(rect.xe, info->var.xres - 1);
+	rect.ye = min(rect.ye, fbdbi_damage_lines(info) - 1);
+	if (fbdbi_rect_empty(&rect))
+		return;
+
+	/* packed monochrome pixels can't be split on a column */
+	if (fbdbi->display->format == FBDBI_FORMAT_MONO10) {
+		rect.xs = 0;
+		rect.xe = info->var.xres - 1;
+	}
 
-	switch (info->fix.visual) {
-	case FB_VISUAL_TRUECOLOR:
-		if (regno < 16) {
-			u32 *pal = info->pseudo_palette;
+restart:
+	for (i = 0; i < damage->num; i++) {
+		struct fbdbi_rect *r = &damage->rects[i];
 
-			val  = chan_to_field(red,   &info->var.red);
-			val |= chan_to_field(green, &info->var.green);
-			val |= chan_to_field(blue,  &info->var.blue);
+		if (fbdbi_rect_contains(r, &rect))
+			return;
 
-			pal[regno] = val;
-			ret = 0;
+		merged = *r;
+		fbdbi_rect_merge(&merged, &rect);
+		if (fbdbi_rect_cost(info, &merged) <=
+		    fbdbi_rect_cost(info, r) + fbdbi_rect_cost(info, &rect)) {
+			rect = merged;
+			fbdbi_damage_remove(damage, i);
+			goto restart;
 		}
-		break;
+	}
+
+	for (i = 0; i < damage->num; i++)
+		fbdbi_rect_subtract(&rect, &damage->rects[i]);
 
+	if (damage->num < FBDBI_DAMAGE_MAX) {
+		damage->rects[damage->num++] = rect;
+		return;
 	}
-	return ret;
+
+	best = 0;
+	best_cost = ULONG_MAX;
+	for (i = 0; i < damage->num; i++) {
+		merged = damage->rects[i];
+		fbdbi_rect_merge(&merged, &rect);
+		cost = fbdbi_rect_cost(info, &merged) -
+		       fbdbi_rect_cost(info, &damage->rects[i]);
+		if (cost < best_cost) {
+			best_cost = cost;
+			best = i;
+		}
+	}
+	fbdbi_rect_merge(&rect, &damage->rects[best]);
+	fbdbi_damage_remove(damage, best);
+	goto restart;
 }
 
-static void dump_fb_var_screeninfo(struct fb_var_screeninfo *var, const char *name)
+/* Sort on first line so the display is written top to bottom */
+static void fbdbi_damage_sort(struct fbdbi_damage *damage)
 {
-#define pr_var(_v)	pr_info("  " #_v " = %u\n", var->_v)
-#define pr_color(_v)	pr_info("  " #_v ": %u,%u\n", var->_v.offset, var->_v.length)
+	struct fbdbi_rect tmp;
+	int i, j;
+
+	for (i = 1; i < damage->num; i++) {
+		tmp = damage->rects[i];
+		for (j = i; j > 0 && damage->rects[j - 1].ys > tmp.ys; j--)
+			damage->rects[j] = damage->rects[j - 1];
+		damage->rects[j] = tmp;
+	}
+}
 
-	pr_info("%s('%s'):\n", __func__, name);
+/* Build a sorted damage list from rects, used by fbdbi-drm for DIRTYFB */
+void fbdbi_damage_from_rects(struct fb_info *info, struct fbdbi_damage *damage,
+			     const struct fbdbi_rect *rects, unsigned num)
+{
+	unsigned i;
 
-	pr_var(xres);
-	pr_var(yres);
-	pr_var(xres_virtual);
-	pr_var(yres_virtual);
-	pr_var(xoffset);
-	pr_var(yoffset);
-	pr_var(bits_per_pixel);
-	pr_var(grayscale);
-	pr_color(red);
-	pr_color(green);
-	pr_color(blue);
-	pr_color(transp);
-	pr_var(nonstd);
-	pr_var(activate);
-	pr_var(height);
-	pr_var(width);
-	pr_var(accel_flags);
-	pr_var(pixclock);
-	pr_var(left_margin);
-	pr_var(right_margin);
-	pr_var(upper_margin);
-	pr_var(lower_margin);
-	pr_var(hsync_len);
-	pr_var(vsync_len);
-	pr_var(sync);
-	pr_var(vmode);
-	pr_var(rotate);
-	pr_var(colorspace);
-	pr_info("\n");
-#undef pr_var
+	damage->num = 0;
+	for (i = 0; i < num; i++)
+		fbdbi_damage_add(info, damage, &rects[i]);
+	fbdbi_damage_sort(damage);
 }
+EXPORT_SYMBOL(fbdbi_damage_from_rects);
 
-/* Only rotation is supported, using rotate or xres/yres swapping. */
-static int fbdbi_fb_check_var(struct fb_var_screeninfo *var, struct fb_info *info)
+/* The first display row that a YUV chroma byte at offset covers */
+static unsigned fbdbi_chroma_row(struct fb_info *info, unsigned long offset)
 {
 	struct fbdbi *fbdbi = info->par;
-	struct fbdbi_display *display = fbdbi->display;
-	u32 rotate = var->rotate;
+	unsigned xres = info->var.xres;
+	unsigned long luma = xres * info->var.yres;
+
+	offset -= luma;
+	if (fbdbi->display->format == FBDBI_FORMAT_I420) {
+		/* U plane followed by V plane, both with xres / 2 stride */
+		if (offset >= luma / 4)
+			offset -= luma / 4;
+		return offset / (xres / 2) * 2;
+	}
 
-pr_info("%s()\n", __func__);
-//dump_fb_var_screeninfo(var, "var");
-//dump_fb_var_screeninfo(&info->var, "info->var");
-	if (!display->rotate)
-		return -ENOSYS;
+	/* interleaved UV plane with xres stride */
+	return offset / xres * 2;
+}
 
-	if (var->xres != info->var.xres || var->yres != info->var.yres) {
-		if (var->xres == display->xres && var->yres == display->yres)
-			rotate = 0;
-		else if (var->xres == display->yres && var->yres == display->xres)
-			rotate = 90;
-		else
-			return -EINVAL;
-	}
+/*
+ * The display rows that the video memory bytes start..end belong to.
+ * A YUV range that crosses a plane boundary covers the whole frame.
+ */
+static void fbdbi_vmem_rows(struct fb_info *info, unsigned long start,
+			    unsigned long end, unsigned *ys, unsigned *ye)
+{
+	struct fbdbi *fbdbi = info->par;
+	unsigned long luma = info->var.xres * info->var.yres;
 
-	*var = info->var;
-	var->rotate = rotate;
+	if (!fbdbi_format_is_yuv(fbdbi->display->format) || end < luma) {
+		*ys = start / info->fix.line_length;
+		*ye = end / info->fix.line_length;
+		return;
+	}
 
-	switch (var->rotate) {
-	case 0:
-	case 180:
-		var->xres = display->xres;
-		var->yres = display->yres;
-		break;
-	case 90:
-	case 270:
-		var->xres = display->yres;
-		var->yres = display->xres;
-		break;
-	default:
-		return -EINVAL;
+	if (start >= luma) {
+		*ys = fbdbi_chroma_row(info, start);
+		*ye = fbdbi_chroma_row(info, end) + 1;
 	}
-	var->xres_virtual = var->xres;
-	var->yres_virtual = var->yres;
+	if (start < luma || *ys > *ye) {
+		*ys = 0;
+		*ye = info->var.yres - 1;
+	}
+	*ye = min(*ye, info->var.yres - 1);
+}
 
-	return 0;
+/*
+ * Add the lines covered by the pages written through mmap.
+ * The pagelist is sorted, so consecutive pages are joined before
+ * they are added.
+ */
+static void fbdbi_damage_add_pagelist(struct fb_info *info,
+				      struct fbdbi_damage *damage,
+				      struct list_head *pagelist, u32 yoffset)
+{
+	struct fbdbi_rect run = {
+		.xs = 0,
+		.xe = info->var.xres - 1,
+		.ys = 1,
+		.ye = 0,
+	};
+	struct page *page;
+	unsigned ys, ye;
+
+	struct fbdbi *fbdbi = info->par;
+	unsigned yres = fbdbi_damage_lines(info);
+
+	list_for_each_entry(page, pagelist, lru) {
+		fbdbi_vmem_rows(info, page->index << PAGE_SHIFT,
+				((page->index + 1) << PAGE_SHIFT) - 1, &ys, &ye);
+
+		/* only the front buffer is sent, back buffers go on flip */
+		if (ye < yoffset || ys >= yoffset + yres)
+			continue;
+		ys = max(ys, yoffset) - yoffset;
+		ye = min(ye - yoffset, yres - 1);
+
+		/* chroma pages map back to rows already seen */
+		if (!fbdbi_rect_empty(&run) && ys <= run.ye + 1 && ye + 1 >= run.ys) {
+			run.ys = min(run.ys, ys);
+			run.ye = max(run.ye, ye);
+			continue;
+		}
+		fbdbi_damage_add(info, damage, &run);
+		run.ys = ys;
+		run.ye = ye;
+	}
+	fbdbi_damage_add(info, damage, &run);
 }
 
-static int fbdbi_fb_set_par(struct fb_info *info)
+static u8 *fbdbi_front_vmem(struct fb_info *info)
 {
 	struct fbdbi *fbdbi = info->par;
-	struct fbdbi_display *display = fbdbi->display;
-	int ret;
 
-pr_info("%s()\n", __func__);
-//dump_fb_var_screeninfo(&info->var, __func__);
-	if (!display->rotate)
-		return -ENOSYS;
+	return (u8 __force *)info->screen_base +
+	       fbdbi->yoffset * info->fix.line_length;
+}
 
-	lcdreg_lock(display->lcdreg);
-	switch (info->var.bits_per_pixel) {
-	case 1:
-		info->fix.line_length = info->var.xres / 8;
-		break;
-	case 8:
-		info->fix.line_length = info->var.xres;
-		break;
-	case 16:
-		info->fix.line_length = info->var.xres * 2;
-		break;
-	case 24:
-		info->fix.line_length = info->var.xres * 3;
-		break;
-	case 32:
-		info->fix.line_length = info->var.xres * 4;
-		break;
+static unsigned fbdbi_damage_bytes(struct fb_info *info, struct fbdbi_damage *damage)
+{
+	struct fbdbi_rect *rect;
+	unsigned bytes = 0;
+	int i;
+
+	for (i = 0; i < damage->num; i++) {
+		rect = &damage->rects[i];
+		bytes += (rect->xe - rect->xs + 1) * (rect->ye - rect->ys + 1) *
+			 info->var.bits_per_pixel / 8;
 	}
-	ret = display->rotate(display);
-	lcdreg_unlock(display->lcdreg);
 
-	return ret;
+	return bytes;
+}
+
+/* compare len bytes, a word at a time if both lines are aligned */
+static bool fbdbi_shadow_line_equal(const u8 *a, const u8 *b, unsigned len)
+{
+	const unsigned long *wa = (const unsigned long *)a;
+	const unsigned long *wb = (const unsigned long *)b;
+
+	if (IS_ALIGNED((unsigned long)a | (unsigned long)b, sizeof(long))) {
+		for (; len >= sizeof(long); len -= sizeof(long))
+			if (*wa++ != *wb++)
+				return false;
+		a = (const u8 *)wa;
+		b = (const u8 *)wb;
+	}
+
+	return !memcmp(a, b, len);
 }
 
 /*
- * Why is fb_ops.fb_blank needed when these panels mostly support
- * white blanking? (backlight shining through)
- *
- * fb_blank() doesn't fire the FB_EVENT_BLANK event unless
- * fb_ops.fb_blank is set and returns 0.
- * Whitout this event, backlight is not turned off on blanking.
- *
- * If however the backlight is always on (hardwired ON), fb_ops.fb_blank
- * must return -EINVAL or else fbcon won't blank/clear the console.
+ * Compare the damaged area tile by tile with the shadow buffer and
+ * replace the damage with the tiles that have actually changed.
+ * Changed tiles are copied to the shadow buffer.
  */
-static int fbdbi_fb_blank(int blank, struct fb_info *info)
+static void fbdbi_shadow_diff(struct fb_info *info, struct fbdbi_damage *damage)
 {
 	struct fbdbi *fbdbi = info->par;
-	struct fbdbi_display *display = fbdbi->display;
-
-dev_info(info->dev, "%s(blank=%d)\n", __func__, blank);
-
-	if (display->blank)
-		return display->blank(display, blank ? true : false);
-	else if (display->backlight)
-		return 0; /* fire FB_EVENT_BLANK event to turn off backlight */
+	unsigned line_length = info->fix.line_length;
+	unsigned bpp = info->var.bits_per_pixel;
+	struct fbdbi_damage changed = { .num = 0 };
+	struct fbdbi_rect *rect, tile;
+	unsigned tx, ty, y, offset, len;
+	u8 *vmem = fbdbi_front_vmem(info);
+	int i;
+
+	fbdbi->shadow_stats.last_damaged = fbdbi_damage_bytes(info, damage);
+
+	if (!fbdbi->shadow_valid) {
+		memcpy(fbdbi->shadow, vmem, line_length * fbdbi_damage_lines(info));
+		fbdbi->shadow_valid = true;
+		goto out;
+	}
 
-	/* let the caller handle blanking */
-	return -EINVAL;
+	for (i = 0; i < damage->num; i++) {
+		rect = &damage->rects[i];
+		for (ty = round_down(rect->ys, FBDBI_TILE_SIZE); ty <= rect->ye; ty += FBDBI_TILE_SIZE) {
+			tile.ys = max(ty, rect->ys);
+			tile.ye = min(ty + FBDBI_TILE_SIZE - 1, rect->ye);
+			for (tx = round_down(rect->xs, FBDBI_TILE_SIZE); tx <= rect->xe; tx += FBDBI_TILE_SIZE) {
+				tile.xs = max(tx, rect->xs);
+				tile.xe = min(tx + FBDBI_TILE_SIZE - 1, rect->xe);
+				offset = tile.xs * bpp / 8;
+				len = (tile.xe - tile.xs + 1) * bpp / 8;
+
+				for (y = tile.ys; y <= tile.ye; y++)
+					if (!fbdbi_shadow_line_equal(vmem + y * line_length + offset,
+								     fbdbi->shadow + y * line_length + offset,
+								     len))
+						break;
+				if (y > tile.ye)
+					continue;
+
+				for (y = tile.ys; y <= tile.ye; y++)
+					memcpy(fbdbi->shadow + y * line_length + offset,
+					       vmem + y * line_length + offset, len);
+				fbdbi_damage_add(info, &changed, &tile);
+			}
+		}
+	}
+	*damage = changed;
+out:
+	fbdbi->shadow_stats.last_sent = fbdbi_damage_bytes(info, damage);
+	fbdbi->shadow_stats.damaged += fbdbi->shadow_stats.last_damaged;
+	fbdbi->shadow_stats.sent += fbdbi->shadow_stats.last_sent;
+	fbdbi->shadow_stats.frames++;
 }
 
 /*
-    unregister_framebuffer() calls put_fb_info(fb_info)
-    fb_destroy is called i ref is zero
+ * When the panel refresh rate is known, lock the period to a whole
+ * number of refresh periods.
  */
-static void fbdbi_fb_destroy(struct fb_info *info)
+static u64 fbdbi_sched_period(struct fbdbi *fbdbi)
+{
+	u64 period = div_u64(NSEC_PER_SEC, fbdbi->fps);
+	u64 n;
+
+	if (!fbdbi->te_period)
+		return period;
+
+	n = div64_u64(period + fbdbi->te_period / 2, fbdbi->te_period);
+
+	return max_t(u64, n, 1) * fbdbi->te_period;
+}
+
+/* Minimum time between the start of two flushes */
+static u64 fbdbi_sched_interval(struct fbdbi *fbdbi)
+{
+	if ((fbdbi->sched == FBDBI_SCHED_THROTTLE ||
+	     fbdbi->sched == FBDBI_SCHED_AUTO) && fbdbi->min_interval)
+		return (u64)fbdbi->min_interval * NSEC_PER_USEC;
+
+	return fbdbi_sched_period(fbdbi);
+}
+
+/* When should damage that arrives now be flushed */
+static ktime_t fbdbi_sched_deadline(struct fb_info *info, ktime_t now)
 {
 	struct fbdbi *fbdbi = info->par;
-	struct fbdbi_display *display = fbdbi->display;
 
-pr_info("%s()\n", __func__);
-	fb_deferred_io_cleanup(info);
-	if (display->backlight) {
-		display->backlight->props.brightness = 0;
-		backlight_update_status(display->backlight);
+	switch (fbdbi->sched) {
+	case FBDBI_SCHED_ONESHOT:
+		return now;
+	case FBDBI_SCHED_DEFERRED:
+		return ktime_add_ns(now, fbdbi_sched_period(fbdbi));
+	case FBDBI_SCHED_AUTO:
+	case FBDBI_SCHED_THROTTLE:
+	case FBDBI_SCHED_FIXED:
+	case FBDBI_SCHED_CONTINUOUS:
+	default:
+		/* leading edge after idle, otherwise trailing */
+		if (ktime_after(fbdbi->next_flush, now))
+			return fbdbi->next_flush;
+		return now;
 	}
-	if (display->poweroff)
-		display->poweroff(display);
 }
 
-static const struct fb_ops fbdbi_fb_ops = {
-//	.owner =          THIS_MODULE,
-//	.fb_open =        fbdbi_fb_open,
-//	.fb_release =     fbdbi_fb_release,
-	.fb_read =        fb_sys_read,
-	.fb_write =       fbdbi_fb_write,
-	.fb_check_var =   fbdbi_fb_check_var,
-	.fb_set_par =     fbdbi_fb_set_par,
-	.fb_setcolreg =   fbdbi_fb_setcolreg,
-	.fb_blank =       fbdbi_fb_blank,
-//	.fb_pan_display = fbdbi_fb_pan_display, 
-	.fb_fillrect =    fbdbi_fb_fillrect,
-	.fb_copyarea =    fbdbi_fb_copyarea,
-	.fb_imageblit =   fbdbi_fb_imageblit,
-//	.fb_cursor =      fbdbi_fb_cursor,
-//	.fb_rotate =      fbdbi_fb_rotate,
-//	.fb_sync =        fbdbi_fb_sync,
-	.fb_destroy =     fbdbi_fb_destroy,
-};
+static enum hrtimer_restart fbdbi_flush_timer(struct hrtimer *timer)
+{
+	struct fbdbi *fbdbi = container_of(timer, struct fbdbi, flush_timer);
+	unsigned long flags;
 
+	spin_lock_irqsave(&fbdbi->dirty_lock, flags);
+	fbdbi->deadline = hrtimer_get_expires(timer);
+	fbdbi->flushing = true;
+	spin_unlock_irqrestore(&fbdbi->dirty_lock, flags);
+	queue_kthread_work(&fbdbi->worker, &fbdbi->flush_work);
 
+	return HRTIMER_NORESTART;
+}
 
-int devm_fbdbi_init(struct device *dev, struct fbdbi_display *display)
+static void fbdbi_schedule(struct fb_info *info)
+{
+	struct fbdbi *fbdbi = info->par;
+	unsigned long flags;
+
+	spin_lock_irqsave(&fbdbi->dirty_lock, flags);
+	if (!fbdbi->stopped && !fbdbi->blanked &&
+	    !hrtimer_is_queued(&fbdbi->flush_timer))
+		hrtimer_start(&fbdbi->flush_timer,
+			      fbdbi_sched_deadline(info, ktime_get()),
+			      HRTIMER_MODE_ABS);
+	spin_unlock_irqrestore(&fbdbi->dirty_lock, flags);
+}
+
+/* Restart the idle countdown, called on damage from clients */
+static void fbdbi_idle_kick(struct fbdbi *fbdbi)
+{
+	if (fbdbi->idle_timeout)
+		mod_timer(&fbdbi->idle_timer,
+			  jiffies + msecs_to_jiffies(fbdbi->idle_timeout));
+}
+
+/* Start the damage-to-glass clock unless this cycle already has damage */
+static void fbdbi_latency_start(struct fbdbi *fbdbi)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&fbdbi->dirty_lock, flags);
+	if (!fbdbi->damage_ns)
+		fbdbi->damage_ns = ktime_get_ns();
+	spin_unlock_irqrestore(&fbdbi->dirty_lock, flags);
+}
+
+/* Called on the worker when update() has returned for the whole flush */
+static void fbdbi_latency_done(struct fbdbi *fbdbi)
+{
+	u64 now = ktime_get_ns();
+	u64 us, elapsed;
+	unsigned bucket;
+
+	fbdbi->latency_stats.window_frames++;
+	elapsed = now - fbdbi->latency_stats.window_start;
+	if (elapsed >= NSEC_PER_SEC) {
+		fbdbi->latency_stats.fps_x10 = div64_u64(
+			(u64)fbdbi->latency_stats.window_frames * 10 * NSEC_PER_SEC,
+			elapsed);
+		fbdbi->latency_stats.window_start = now;
+		fbdbi->latency_stats.window_frames = 0;
+	}
+
+	if (!fbdbi->cycle_ns)
+		return;
+
+	us = div64_u64(now - fbdbi->cycle_ns, NSEC_PER_USEC);
+	fbdbi->cycle_ns = 0;
+	bucket = us ? min_t(unsigned, ilog2(us), FBDBI_LATENCY_BUCKETS - 1) : 0;
+	fbdbi->latency_stats.hist[bucket]++;
+	fbdbi->latency_stats.count++;
+	fbdbi->latency_stats.sum += us;
+	if (us > fbdbi->latency_stats.max)
+		fbdbi->latency_stats.max = us;
+}
+
+/* fb_defio: first write to mmap'ed memory since the last flush */
+static void fbdbi_first_io(struct fb_info *info)
+{
+	fbdbi_latency_start(info->par);
+	fbdbi_idle_kick(info->par);
+	fbdbi_schedule(info);
+}
+
+/*
+ * Called at the start of a flush to set the earliest time for the next one
+ * and check if the flush started in time.
+ */
+static void fbdbi_sched_flushed(struct fb_info *info)
+{
+	struct fbdbi *fbdbi = info->par;
+	u64 period = fbdbi_sched_period(fbdbi);
+	ktime_t now = ktime_get();
+	s64 late;
+
+	late = ktime_to_ns(ktime_sub(now, fbdbi->deadline));
+	fbdbi->deadline = now;
+	fbdbi->pacing_stats.flushes++;
+	fbdbi->pacing_stats.last_late = late;
+	if (late > fbdbi->pacing_stats.max_late)
+		fbdbi->pacing_stats.max_late = late;
+	if (late > period) {
+		fbdbi->pacing_stats.missed++;
+		dev_dbg(info->dev, "flush missed its deadline by %lld us\n",
+			div_s64(late, NSEC_PER_USEC));
+	}
+
+	if (fbdbi->sched == FBDBI_SCHED_FIXED ||
+	    fbdbi->sched == FBDBI_SCHED_CONTINUOUS) {
+		/* stay on the grid, skip the slots that were missed */
+		fbdbi->next_flush = ktime_add_ns(fbdbi->next_flush, period);
+		if (!ktime_after(fbdbi->next_flush, now))
+			fbdbi->next_flush = ktime_add_ns(now, period);
+	} else {
+		fbdbi->next_flush = ktime_add_ns(now,
+					fbdbi_sched_interval(fbdbi));
+	}
+}
+
+static void __fbdbi_mkdirty(struct fb_info *info, int x, int y, int width, int height)
+{
+	struct fbdbi *fbdbi = info->par;
+	unsigned long flags;
+	struct fbdbi_rect rect = {
+		.xs = x,
+		.xe = x + width - 1,
+		.ys = y,
+		.ye = y + height - 1,
+	};
+
+	if (width <= 0 || height <= 0)
+		return;
+
+	/* Mark the specified display area as dirty */
+	spin_lock_irqsave(&fbdbi->dirty_lock, flags);
+	/* y is virtual, drawing in a back buffer is sent when it's flipped */
+	rect.ys = max_t(int, y, fbdbi->pan_yoffset);
+	rect.ye = min_t(int, rect.ye,
+			fbdbi->pan_yoffset + fbdbi_damage_lines(info) - 1);
+	if (rect.ys > rect.ye) {
+		spin_unlock_irqrestore(&fbdbi->dirty_lock, flags);
+		return;
+	}
+	rect.ys -= fbdbi->pan_yoffset;
+	rect.ye -= fbdbi->pan_yoffset;
+	fbdbi_damage_add(info, &fbdbi->damage, &rect);
+	spin_unlock_irqrestore(&fbdbi->dirty_lock, flags);
+
+	/* Arm the flush timer (no-op if already armed) */
+	fbdbi_schedule(info);
+}
+
+static void fbdbi_mkdirty(struct fb_info *info, int x, int y, int width, int height)
+{
+	fbdbi_latency_start(info->par);
+	fbdbi_idle_kick(info->par);
+	__fbdbi_mkdirty(info, x, y, width, height);
+}
+
+/* Refresh rates outside 20-200 Hz are treated as glitches */
+#define FBDBI_TE_PERIOD_MIN	(NSEC_PER_SEC / 200)
+#define FBDBI_TE_PERIOD_MAX	(NSEC_PER_SEC / 20)
+
+static irqreturn_t fbdbi_te_irq(int irq, void *data)
+{
+	struct fbdbi *fbdbi = data;
+	ktime_t now = ktime_get();
+	s64 period;
+
+	period = ktime_to_ns(ktime_sub(now, fbdbi->te_last));
+	fbdbi->te_last = now;
+	fbdbi->te_count++;
+
+	/* average the measured refresh period over 8 frames */
+	if (period >= FBDBI_TE_PERIOD_MIN && period <= FBDBI_TE_PERIOD_MAX) {
+		if (fbdbi->te_period)
+			fbdbi->te_period = (fbdbi->te_period * 7 + period) / 8;
+		else
+			fbdbi->te_period = period;
+	}
+
+	complete(&fbdbi->te_complete);
+
+	return IRQ_HANDLED;
+}
+
+/* Wait for the panel to start a new frame */
+static void fbdbi_te_wait(struct fb_info *info)
+{
+	struct fbdbi *fbdbi = info->par;
+	unsigned long ret;
+
+	reinit_completion(&fbdbi->te_complete);
+	ret = wait_for_completion_timeout(&fbdbi->te_complete,
+					  msecs_to_jiffies(100));
+	if (!ret) {
+		fbdbi->te_timeouts++;
+		dev_warn_ratelimited(info->dev, "timeout waiting for TE\n");
+	}
+}
+
+/* Measure the bus throughput used to estimate how long an update takes */
+static void fbdbi_te_write_rate(struct fbdbi *fbdbi, unsigned bytes, ktime_t start)
+{
+	s64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	u64 rate;
+
+	if (ns <= 0 || !bytes)
+		return;
+
+	rate = div64_u64((u64)bytes * NSEC_PER_SEC, ns);
+	if (fbdbi->write_rate)
+		fbdbi->write_rate = (fbdbi->write_rate * 7 + rate) / 8;
+	else
+		fbdbi->write_rate = rate;
+}
+
+/* Copy the damaged area from the front buffer to the snapshot */
+static void fbdbi_snapshot(struct fb_info *info, struct fbdbi_damage *damage)
+{
+	struct fbdbi *fbdbi = info->par;
+	unsigned line_length = info->fix.line_length;
+	unsigned bpp = info->var.bits_per_pixel;
+	u8 *vmem = fbdbi_front_vmem(info);
+	struct fbdbi_rect *rect;
+	unsigned y, offset, len;
+	int i;
+
+	/* the shadow buffer already holds a copy of the changed tiles */
+	if (fbdbi->snapshot == fbdbi->shadow)
+		return;
+
+	if (!fbdbi->snapshot_valid) {
+		memcpy(fbdbi->snapshot, vmem, line_length * fbdbi_damage_lines(info));
+		fbdbi->snapshot_valid = true;
+		return;
+	}
+
+	for (i = 0; i < damage->num; i++) {
+		rect = &damage->rects[i];
+		offset = rect->xs * bpp / 8;
+		len = (rect->xe - rect->xs + 1) * bpp / 8;
+		for (y = rect->ys; y <= rect->ye; y++)
+			memcpy(fbdbi->snapshot + y * line_length + offset,
+			       vmem + y * line_length + offset, len);
+	}
+}
+
+static bool fbdbi_sw_rotated(struct fbdbi_display *display)
+{
+	return display->sw_rotate && display->info->var.rotate;
+}
+
+/* Translate a framebuffer rectangle to panel coordinates and update it */
+static int fbdbi_update_rect(struct fbdbi_display *display,
+			     const struct fbdbi_rect *rect)
+{
+	unsigned w = display->xres;
+	unsigned h = display->yres;
+
+	if (!fbdbi_sw_rotated(display))
+		return display->update(display, rect->xs, rect->xe,
+				       rect->ys, rect->ye);
+
+	switch (display->info->var.rotate) {
+	case 90:
+		return display->update(display, rect->ys, rect->ye,
+				       h - 1 - rect->xe, h - 1 - rect->xs);
+	case 180:
+		return display->update(display, w - 1 - rect->xe, w - 1 - rect->xs,
+				       h - 1 - rect->ye, h - 1 - rect->ys);
+	case 270:
+		return display->update(display, w - 1 - rect->ye, w - 1 - rect->ys,
+				       rect->xs, rect->xe);
+	default:
+		return -EINVAL;
+	}
+}
+
+/*
+ * Send a band of lines y0..y1 that takes w ns on the bus, timed from its
+ * own TE pulse. A write faster than the scan starts on the pulse and
+ * stays ahead of it. A slower one starts d after the pulse so it stays
+ * behind the scan: d >= y0 * line time and d + w >= (y1 + 1) * line time.
+ * With a ywrap scroll line >= 0 it is written on the first pulse.
+ */
+static void fbdbi_te_send(struct fb_info *info, struct fbdbi_damage *band,
+			  unsigned y0, unsigned y1, u64 w, s64 *scroll_line)
+{
+	struct fbdbi *fbdbi = info->par;
+	struct fbdbi_display *display = fbdbi->display;
+	u64 line_ns = div_u64(fbdbi->te_period, info->var.yres);
+	u64 d = 0;
+	ktime_t start;
+	s64 us;
+	int i;
+
+	if (w > y1 * line_ns) {
+		d = y0 * line_ns;
+		if ((y1 + 1) * line_ns > w)
+			d = max(d, (y1 + 1) * line_ns - w);
+	}
+
+	fbdbi_te_wait(info);
+	if (*scroll_line >= 0) {
+		lcdreg_lock(display->lcdreg);
+		display->scroll(display, info->var.yres, *scroll_line);
+		lcdreg_unlock(display->lcdreg);
+		*scroll_line = -1;
+	}
+	if (d) {
+		us = ktime_us_delta(ktime_add_ns(fbdbi->te_last, d), ktime_get());
+		if (us > 0)
+			usleep_range(us, us + 20);
+	}
+
+	start = ktime_get();
+	for (i = 0; i < band->num; i++)
+		fbdbi_update_rect(display, &band->rects[i]);
+	fbdbi_te_write_rate(fbdbi, fbdbi_damage_bytes(info, band), start);
+}
+
+/*
+ * Chase the panel scan. The damage is sorted top-down and split into
+ * bands that each fit between two scans: the write of a band y0..y1 must
+ * be done before the next scan reaches y1, which is possible while it
+ * takes at most a refresh period plus (y1 - y0) line times. A full frame
+ * can take up to two periods, a slower bus sends it over several frames.
+ */
+static void fbdbi_te_transfer(struct fb_info *info,
+			      struct fbdbi_damage *damage, s64 scroll_line)
+{
+	struct fbdbi *fbdbi = info->par;
+	u64 period = fbdbi->te_period;
+	u64 rate = fbdbi->write_rate;
+	u64 line_ns, row_ns, band_ns = 0;
+	struct fbdbi_damage band = { .num = 0 };
+	struct fbdbi_rect *rect, part;
+	unsigned y, y0 = 0, y1 = 0;
+	bool open = false;
+	int i;
+
+	/* not measured yet, or the writes go to an offscreen part of GRAM */
+	if (!period || !rate || fbdbi->gram_flip) {
+		fbdbi_te_send(info, damage, 0, 0, 0, &scroll_line);
+		return;
+	}
+
+	line_ns = div_u64(period, info->var.yres);
+	for (i = 0; i < damage->num; i++) {
+		rect = &damage->rects[i];
+		row_ns = div64_u64((u64)(rect->xe - rect->xs + 1) *
+				   info->var.bits_per_pixel / 8 * NSEC_PER_SEC,
+				   rate);
+		part = *rect;
+		for (y = rect->ys; y <= rect->ye; y++) {
+			if (open && band_ns + row_ns > period + (y - y0) * line_ns) {
+				if (y > part.ys) {
+					part.ye = y - 1;
+					band.rects[band.num++] = part;
+				}
+				fbdbi_te_send(info, &band, y0, y1, band_ns,
+					      &scroll_line);
+				band.num = 0;
+				open = false;
+				part.ys = y;
+			}
+			if (!open) {
+				open = true;
+				y0 = y;
+				y1 = y;
+				band_ns = 0;
+			}
+			band_ns += row_ns;
+			y1 = max(y1, y);
+		}
+		part.ye = rect->ye;
+		if (part.ys <= part.ye)
+			band.rects[band.num++] = part;
+	}
+
+	if (open || scroll_line >= 0)
+		fbdbi_te_send(info, &band, y0, y1, band_ns, &scroll_line);
+}
+
+static void fbdbi_transfer(struct fb_info *info, struct fbdbi_damage *damage)
+{
+	struct fbdbi *fbdbi = info->par;
+	struct fbdbi_display *display = fbdbi->display;
+	struct fbdbi_rect *rect;
+	bool scroll;
+	u32 line;
+	int i;
+
+	spin_lock_irq(&fbdbi->dirty_lock);
+	scroll = fbdbi->scroll_pending;
+	line = fbdbi->scroll_line;
+	fbdbi->scroll_pending = false;
+	spin_unlock_irq(&fbdbi->dirty_lock);
+
+	if (fbdbi->idle && damage->num) {
+		if (display->idle) {
+			lcdreg_lock(display->lcdreg);
+			display->idle(display, false);
+			lcdreg_unlock(display->lcdreg);
+		}
+		fbdbi->idle = false;
+	}
+
+	/* ywrap: the new lines follow in the same flush */
+	if (fbdbi->te && (damage->num || (scroll && !fbdbi->gram_flip))) {
+		fbdbi_te_transfer(info, damage,
+				  scroll && !fbdbi->gram_flip ? line : -1);
+	} else {
+		if (scroll && !fbdbi->gram_flip) {
+			lcdreg_lock(display->lcdreg);
+			display->scroll(display, info->var.yres, line);
+			lcdreg_unlock(display->lcdreg);
+		}
+
+		for (i = 0; i < damage->num; i++) {
+			rect = &damage->rects[i];
+			fbdbi_update_rect(display, rect);
+			// notify error?
+		}
+	}
+
+	/* page flip after the new buffer is in GRAM, on the next TE pulse */
+	if (scroll && fbdbi->gram_flip) {
+		if (fbdbi->te)
+			fbdbi_te_wait(info);
+		lcdreg_lock(display->lcdreg);
+		display->scroll(display, display->gram_height, line);
+		lcdreg_unlock(display->lcdreg);
+	}
+
+	if (damage->num || scroll)
+		fbdbi_latency_done(fbdbi);
+
+	spin_lock_irq(&fbdbi->dirty_lock);
+	fbdbi->flushing = false;
+	fbdbi->flush_seq++;
+	fbdbi->flush_time = ktime_get();
+	spin_unlock_irq(&fbdbi->dirty_lock);
+	wake_up_all(&fbdbi->flush_wait);
+	sysfs_notify(&info->dev->kobj, NULL, "flush_seq");
+
+	if (fbdbi->sched == FBDBI_SCHED_CONTINUOUS)
+		__fbdbi_mkdirty(info, 0, 0, info->var.xres, info->var.yres);
+	/* the last flush after close, fbdbi_release_buffers() rechecks */
+	else if (display->lazy_vmem && !fbdbi->open_count)
+		queue_kthread_work(&fbdbi->worker, &fbdbi->release_work);
+}
+
+/* Allocate lazy video memory, returns 1 if it was allocated now */
+static int fbdbi_vmem_get(struct fb_info *info)
+{
+	struct fbdbi *fbdbi = info->par;
+	void *vmem;
+
+	if (info->screen_base)
+		return 0;
+
+	vmem = vzalloc(info->fix.smem_len);
+	if (!vmem)
+		return -ENOMEM;
+
+	info->screen_base = (u8 __force __iomem *)vmem;
+	fbdbi->shadow_valid = false;
+	fbdbi->snapshot_valid = false;
+
+	return 1;
+}
+
+/*
+ * Lazy video memory can go when nothing has it open and nothing written
+ * through mmap is still on its way to the display. fb_defio's fallback
+ * work is run first, it hands its pages to fbdbi->damage.
+ */
+static bool fbdbi_vmem_busy(struct fbdbi *fbdbi)
+{
+	struct fb_info *info = fbdbi->display->info;
+	struct fb_deferred_io *fbdefio = info->fbdefio;
+	bool busy;
+
+	flush_delayed_work(&info->deferred_work);
+
+	mutex_lock(&fbdefio->lock);
+	busy = !list_empty(&fbdefio->pagelist);
+	mutex_unlock(&fbdefio->lock);
+
+	spin_lock_irq(&fbdbi->dirty_lock);
+	busy |= fbdbi->flushing || fbdbi->damage.num ||
+		hrtimer_active(&fbdbi->flush_timer);
+	spin_unlock_irq(&fbdbi->dirty_lock);
+
+	return busy;
+}
+
+/*
+ * With lazy-alloc, free the transfer buffers, and the video memory when the
+ * fb isn't open. Runs on the flush worker, so no transfer is using them.
+ * The video memory pages are handed back by fb_deferred_io_cleanup(), which
+ * is then undone with a fresh fb_deferred_io_init() for the next open.
+ */
+static void fbdbi_release_buffers(struct fbdbi *fbdbi)
+{
+	struct fbdbi_display *display = fbdbi->display;
+	struct fb_info *info = display->info;
+	int (*fb_mmap)(struct fb_info *info, struct vm_area_struct *vma);
+
+	if (!display->lazy_vmem)
+		return;
+
+	mutex_lock(&fbdbi->vmem_lock);
+	if (!fbdbi->open_count && info->screen_base &&
+	    !fbdbi_vmem_busy(fbdbi)) {
+		dev_dbg(info->dev, "releasing video memory\n");
+		fb_mmap = info->fbops->fb_mmap;
+		fb_deferred_io_cleanup(info);
+		vfree((void __force *)info->screen_base);
+		info->screen_base = NULL;
+		fb_deferred_io_init(info);
+		info->fbops->fb_mmap = fb_mmap;
+	}
+	mutex_unlock(&fbdbi->vmem_lock);
+
+	vfree(fbdbi->txbuf);
+	fbdbi->txbuf = NULL;
+
+	lcdreg_lock(display->lcdreg);
+	lcdreg_release_buffers(display->lcdreg);
+	lcdreg_unlock(display->lcdreg);
+}
+
+static void fbdbi_idle_timer(unsigned long data)
+{
+	struct fbdbi *fbdbi = (struct fbdbi *)data;
+
+	queue_kthread_work(&fbdbi->worker, &fbdbi->idle_work);
+}
+
+/*
+ * No damage from clients for idle_timeout ms. Runs on the flush worker,
+ * so it doesn't race a transfer. The continuous refresh is dropped, which
+ * leaves the worker asleep until the next damage.
+ */
+static void fbdbi_idle_work(struct kthread_work *work)
+{
+	struct fbdbi *fbdbi = container_of(work, struct fbdbi, idle_work);
+	struct fbdbi_display *display = fbdbi->display;
+	bool busy;
+
+	spin_lock_irq(&fbdbi->dirty_lock);
+	busy = fbdbi->stopped || fbdbi->blanked ||
+	       timer_pending(&fbdbi->idle_timer) ||
+	       (fbdbi->sched != FBDBI_SCHED_CONTINUOUS && fbdbi->damage.num);
+	if (!busy && fbdbi->sched == FBDBI_SCHED_CONTINUOUS) {
+		hrtimer_try_to_cancel(&fbdbi->flush_timer);
+		fbdbi->damage.num = 0;
+	}
+	spin_unlock_irq(&fbdbi->dirty_lock);
+
+	if (busy)
+		return;
+
+	if (!fbdbi->idle) {
+		dev_dbg(display->info->dev, "entering idle mode\n");
+		if (display->idle) {
+			lcdreg_lock(display->lcdreg);
+			display->idle(display, true);
+			lcdreg_unlock(display->lcdreg);
+		}
+		fbdbi->idle = true;
+	}
+
+	fbdbi_release_buffers(fbdbi);
+}
+
+static void fbdbi_release_work(struct kthread_work *work)
+{
+	struct fbdbi *fbdbi = container_of(work, struct fbdbi, release_work);
+
+	fbdbi_release_buffers(fbdbi);
+}
+
+/*
+ * Flush on the display's worker. The pages written through mmap are
+ * collected like fb_deferred_io_work() does, but fbdefio->lock is only
+ * held while they are write protected again and turned into damage.
+ * The transfer runs without it, so writes to mmap'ed memory don't block
+ * on the bus. A page written during the transfer faults and is sent in
+ * the next flush, with a snapshot the transfer doesn't see the write.
+ */
+static void fbdbi_flush_work(struct kthread_work *work)
+{
+	struct fbdbi *fbdbi = container_of(work, struct fbdbi, flush_work);
+	struct fb_info *info = fbdbi->display->info;
+	struct fb_deferred_io *fbdefio = info->fbdefio;
+	struct list_head *node, *next;
+	struct fbdbi_damage damage;
+	struct page *page;
+	bool hold;
+
+	/* fb_defio's own work is only a fallback, see fbdbi_deferred_io() */
+	cancel_delayed_work(&info->deferred_work);
+
+	mutex_lock(&fbdefio->lock);
+	list_for_each_entry(page, &fbdefio->pagelist, lru) {
+		lock_page(page);
+		page_mkclean(page);
+		unlock_page(page);
+	}
+
+	spin_lock_irq(&fbdbi->dirty_lock);
+	/* lazy video memory is redrawn in full when it is allocated */
+	hold = fbdbi->blanked || !info->screen_base;
+	if (hold) {
+		/* keep the damage for the flush on unblank */
+		fbdbi_damage_add_pagelist(info, &fbdbi->damage,
+					  &fbdefio->pagelist, fbdbi->pan_yoffset);
+		fbdbi->flushing = false;
+	} else {
+		damage = fbdbi->damage;
+		/* set display area as clean */
+		fbdbi->damage.num = 0;
+		fbdbi->cycle_ns = fbdbi->damage_ns;
+		fbdbi->damage_ns = 0;
+		fbdbi->yoffset = fbdbi->pan_yoffset;
+		fbdbi_damage_add_pagelist(info, &damage, &fbdefio->pagelist,
+					  fbdbi->yoffset);
+	}
+	spin_unlock_irq(&fbdbi->dirty_lock);
+
+	list_for_each_safe(node, next, &fbdefio->pagelist)
+		list_del(node);
+	mutex_unlock(&fbdefio->lock);
+
+	if (hold) {
+		wake_up_all(&fbdbi->flush_wait);
+		return;
+	}
+
+	fbdbi_sched_flushed(info);
+	if (fbdbi->shadow && damage.num)
+		fbdbi_shadow_diff(info, &damage);
+	fbdbi_damage_sort(&damage);
+	if (fbdbi->snapshot)
+		fbdbi_snapshot(info, &damage);
+	fbdbi_transfer(info, &damage);
+}
+
+/*
+ * fb_defio's delayed work, it only runs if no flush collected the pages
+ * within fbdefio->delay, e.g. while stopped. The pages are already write
+ * protected again, hand them to the next flush.
+ */
+static void fbdbi_deferred_io(struct fb_info *info, struct list_head *pagelist)
+{
+	struct fbdbi *fbdbi = info->par;
+
+	spin_lock_irq(&fbdbi->dirty_lock);
+	fbdbi_damage_add_pagelist(info, &fbdbi->damage, pagelist,
+				  fbdbi->pan_yoffset);
+	spin_unlock_irq(&fbdbi->dirty_lock);
+
+	fbdbi_schedule(info);
+}
+
+
+
+
+
+static void fbdbi_fb_fillrect(struct fb_info *info, const struct fb_fillrect *rect)
+{
+	sys_fillrect(info, rect);
+	fbdbi_mkdirty(info, rect->dx, rect->dy, rect->width, rect->height);
+}
+
+static void fbdbi_fb_copyarea(struct fb_info *info, const struct fb_copyarea *area)
+{
+	sys_copyarea(info, area);
+	fbdbi_mkdirty(info, area->dx, area->dy, area->width, area->height);
+}
+
+static void fbdbi_fb_imageblit(struct fb_info *info, const struct fb_image *image)
+{
+	sys_imageblit(info, image);
+	fbdbi_mkdirty(info, image->dx, image->dy, image->width, image->height);
+}
+
+/*
+ * Mark the video memory byte range offset..offset+len as dirty.
+ * The range is split in a partial first line, full lines and a partial
+ * last line. Consecutive writes end up in the same flush and are merged
+ * by the damage list.
+ */
+static void fbdbi_mkdirty_range(struct fb_info *info, unsigned long offset,
+				size_t len)
+{
+	struct fbdbi *fbdbi = info->par;
+	unsigned line_length = info->fix.line_length;
+	unsigned bpp = info->var.bits_per_pixel;
+	unsigned long end = offset + len - 1;
+	unsigned ys = offset / line_length;
+	unsigned ye = end / line_length;
+	unsigned xs = (offset % line_length) * 8 / bpp;
+	unsigned xe = (end % line_length) * 8 / bpp;
+
+	if (fbdbi_format_is_yuv(fbdbi->display->format)) {
+		fbdbi_vmem_rows(info, offset, end, &ys, &ye);
+		fbdbi_mkdirty(info, 0, ys, info->var.xres, ye - ys + 1);
+		return;
+	}
+
+	if (ys == ye) {
+		fbdbi_mkdirty(info, xs, ys, xe - xs + 1, 1);
+		return;
+	}
+
+	if (xs) {
+		fbdbi_mkdirty(info, xs, ys, info->var.xres - xs, 1);
+		ys++;
+	}
+	if (xe < info->var.xres - 1) {
+		fbdbi_mkdirty(info, 0, ye, xe + 1, 1);
+		ye--;
+	}
+	if (ys <= ye)
+		fbdbi_mkdirty(info, 0, ys, info->var.xres, ye - ys + 1);
+}
+
+static ssize_t fbdbi_fb_write(struct fb_info *info,
+			const char __user *buf, size_t count, loff_t *ppos)
+{
+	ssize_t res;
+
+	res = fb_sys_write(info, buf, count, ppos);
+	if (res > 0)
+		fbdbi_mkdirty_range(info, *ppos - res, res);
+
+	return res;
+}
+
+static unsigned int chan_to_field(unsigned chan, struct fb_bitfield *bf)
+{
+	chan &= 0xffff;
+	chan >>= 16 - bf->length;
+	return chan << bf->offset;
+}
+
+/* The LUT is applied when sending, so every pixel can have changed */
+static void fbdbi_lut_changed(struct fb_info *info)
+{
+	struct fbdbi *fbdbi = info->par;
+
+	fbdbi->shadow_valid = false;
+	fbdbi_mkdirty(info, 0, fbdbi->pan_yoffset,
+		      info->var.xres, info->var.yres);
+}
+
+static int __fbdbi_fb_setcolreg(unsigned regno,
+				unsigned red, unsigned green, unsigned blue,
+				unsigned transp, struct fb_info *info)
+{
+	unsigned val;
+	int ret = 1;
+
+	switch (info->fix.visual) {
+	case FB_VISUAL_TRUECOLOR:
+		if (regno < 16) {
+			u32 *pal = info->pseudo_palette;
+
+			val  = chan_to_field(red,   &info->var.red);
+			val |= chan_to_field(green, &info->var.green);
+			val |= chan_to_field(blue,  &info->var.blue);
+
+			pal[regno] = val;
+			ret = 0;
+		}
+		break;
+	case FB_VISUAL_PSEUDOCOLOR:
+		if (regno < 256) {
+			struct fbdbi *fbdbi = info->par;
+
+			if (fbdbi_wire_format(fbdbi->display) == FBDBI_FORMAT_RGB565)
+				val = ((red >> 11) << 11) | ((green >> 10) << 5) |
+				      (blue >> 11);
+			else
+				val = ((red >> 8) << 16) | ((green >> 8) << 8) |
+				      (blue >> 8);
+			fbdbi->lut[regno] = val;
+			ret = 0;
+		}
+		break;
+	}
+	return ret;
+}
+
+static int fbdbi_fb_setcolreg(unsigned regno,
+			       unsigned red, unsigned green, unsigned blue,
+			       unsigned transp, struct fb_info *info)
+{
+	int ret;
+
+	ret = __fbdbi_fb_setcolreg(regno, red, green, blue, transp, info);
+	if (!ret && info->fix.visual == FB_VISUAL_PSEUDOCOLOR)
+		fbdbi_lut_changed(info);
+
+	return ret;
+}
+
+/* Same as fb_set_cmap()'s setcolreg loop, but only one full redraw */
+static int fbdbi_fb_setcmap(struct fb_cmap *cmap, struct fb_info *info)
+{
+	u16 *red = cmap->red;
+	u16 *green = cmap->green;
+	u16 *blue = cmap->blue;
+	u16 *transp = cmap->transp;
+	unsigned regno = cmap->start;
+	u16 trans = 0xffff;
+	int i;
+
+	for (i = 0; i < cmap->len; i++) {
+		if (transp)
+			trans = *transp++;
+		if (__fbdbi_fb_setcolreg(regno++, *red++, *green++, *blue++,
+					 trans, info))
+			break;
+	}
+
+	if (info->fix.visual == FB_VISUAL_PSEUDOCOLOR)
+		fbdbi_lut_changed(info);
+
+	return 0;
+}
+
+static void dump_fb_var_screeninfo(struct fb_var_screeninfo *var, const char *name)
+{
+#define pr_var(_v)	pr_info("  " #_v " = %u\n", var->_v)
+#define pr_color(_v)	pr_info("  " #_v ": %u,%u\n", var->_v.offset, var->_v.length)
+
+	pr_info("%s('%s'):\n", __func__, name);
+
+	pr_var(xres);
+	pr_var(yres);
+	pr_var(xres_virtual);
+	pr_var(yres_virtual);
+	pr_var(xoffset);
+	pr_var(yoffset);
+	pr_var(bits_per_pixel);
+	pr_var(grayscale);
+	pr_color(red);
+	pr_color(green);
+	pr_color(blue);
+	pr_color(transp);
+	pr_var(nonstd);
+	pr_var(activate);
+	pr_var(height);
+	pr_var(width);
+	pr_var(accel_flags);
+	pr_var(pixclock);
+	pr_var(left_margin);
+	pr_var(right_margin);
+	pr_var(upper_margin);
+	pr_var(lower_margin);
+	pr_var(hsync_len);
+	pr_var(vsync_len);
+	pr_var(sync);
+	pr_var(vmode);
+	pr_var(rotate);
+	pr_var(colorspace);
+	pr_info("\n");
+#undef pr_var
+}
+
+/* Only rotation is supported, using rotate or xres/yres swapping. */
+static int fbdbi_fb_check_var(struct fb_var_screeninfo *var, struct fb_info *info)
+{
+	struct fbdbi *fbdbi = info->par;
+	struct fbdbi_display *display = fbdbi->display;
+	u32 rotate = var->rotate;
+
+pr_info("%s()\n", __func__);
+//dump_fb_var_screeninfo(var, "var");
+//dump_fb_var_screeninfo(&info->var, "info->var");
+	if (!display->rotate && !display->sw_rotate)
+		return -ENOSYS;
+
+	if (var->xres != info->var.xres || var->yres != info->var.yres) {
+		if (var->xres == display->xres && var->yres == display->yres)
+			rotate = 0;
+		else if (var->xres == display->yres && var->yres == display->xres)
+			rotate = 90;
+		else
+			return -EINVAL;
+	}
+
+	/* software rotation works on whole bytes per pixel */
+	if (!display->rotate && rotate && (info->var.bits_per_pixel < 8 ||
+	    fbdbi_format_is_yuv(display->format)))
+		return -EINVAL;
+
+	*var = info->var;
+	var->rotate = rotate;
+
+	switch (var->rotate) {
+	case 0:
+	case 180:
+		var->xres = display->xres;
+		var->yres = display->yres;
+		break;
+	case 90:
+	case 270:
+		var->xres = display->yres;
+		var->yres = display->xres;
+		break;
+	default:
+		return -EINVAL;
+	}
+	var->xres_virtual = var->xres;
+	var->yres_virtual = var->yres * display->buffers;
+	var->xoffset = 0;
+	var->yoffset = 0;
+
+	return 0;
+}
+
+/*
+ * The controller scrolls along the unrotated panel height, which is also
+ * the framebuffer height in rotation 0. With one buffer this gives ywrap,
+ * with more buffers and enough GRAM each buffer gets its own part of GRAM
+ * and a page flip is a scroll start change.
+ */
+static void fbdbi_set_scroll_mode(struct fb_info *info)
+{
+	struct fbdbi *fbdbi = info->par;
+	struct fbdbi_display *display = fbdbi->display;
+	bool scroll = display->scroll && !info->var.rotate;
+
+	fbdbi->ywrap = scroll && display->buffers == 1;
+	/* a snapshot sized for one buffer can't take the others */
+	fbdbi->gram_flip = scroll && display->buffers > 1 &&
+			   display->gram_height >= info->var.yres_virtual &&
+			   (!fbdbi->snapshot ||
+			    fbdbi->snapshot_size == info->fix.smem_len);
+	if (fbdbi->ywrap) {
+		info->fix.ywrapstep = 1;
+		info->flags |= FBINFO_HWACCEL_YWRAP;
+	} else {
+		info->fix.ywrapstep = 0;
+		info->flags &= ~FBINFO_HWACCEL_YWRAP;
+	}
+}
+
+static int fbdbi_fb_set_par(struct fb_info *info)
+{
+	struct fbdbi *fbdbi = info->par;
+	struct fbdbi_display *display = fbdbi->display;
+	int ret;
+
+pr_info("%s()\n", __func__);
+//dump_fb_var_screeninfo(&info->var, __func__);
+	if (!display->rotate && !display->sw_rotate)
+		return -ENOSYS;
+
+	lcdreg_lock(display->lcdreg);
+	switch (info->var.bits_per_pixel) {
+	case 1:
+		info->fix.line_length = info->var.xres / 8;
+		break;
+	case 8:
+	case 12: /* YUV 4:2:0 luma plane */
+		info->fix.line_length = info->var.xres;
+		break;
+	case 16:
+		info->fix.line_length = info->var.xres * 2;
+		break;
+	case 24:
+		info->fix.line_length = info->var.xres * 3;
+		break;
+	case 32:
+		info->fix.line_length = info->var.xres * 4;
+		break;
+	}
+	ret = display->rotate ? display->rotate(display) : 0;
+	lcdreg_unlock(display->lcdreg);
+	fbdbi->shadow_valid = false;
+	fbdbi->snapshot_valid = false;
+	fbdbi_set_scroll_mode(info);
+
+	spin_lock_irq(&fbdbi->dirty_lock);
+	fbdbi->pan_yoffset = fbdbi->gram_flip ? 0 : info->var.yoffset;
+	if (fbdbi->scroll_line) {
+		fbdbi->scroll_line = 0;
+		fbdbi->scroll_pending = true;
+	}
+	spin_unlock_irq(&fbdbi->dirty_lock);
+
+	return ret;
+}
+
+/*
+ * Why is fb_ops.fb_blank needed when these panels mostly support
+ * white blanking? (backlight shining through)
+ *
+ * fb_blank() doesn't fire the FB_EVENT_BLANK event unless
+ * fb_ops.fb_blank is set and returns 0.
+ * Whitout this event, backlight is not turned off on blanking.
+ *
+ * If however the backlight is always on (hardwired ON), fb_ops.fb_blank
+ * must return -EINVAL or else fbcon won't blank/clear the console.
+ */
+static int fbdbi_fb_blank(int blank, struct fb_info *info)
+{
+	struct fbdbi *fbdbi = info->par;
+	struct fbdbi_display *display = fbdbi->display;
+	int ret;
+
+dev_info(info->dev, "%s(blank=%d)\n", __func__, blank);
+
+	if (display->blank)
+		ret = display->blank(display, blank ? true : false);
+	else if (display->backlight)
+		ret = 0; /* fire FB_EVENT_BLANK event to turn off backlight */
+	else
+		return -EINVAL; /* let the caller handle blanking */
+
+	if (ret)
+		return ret;
+
+	/*
+	 * Nobody can see the panel, so only collect damage while blanked
+	 * and send it in one flush on unblank.
+	 */
+	spin_lock_irq(&fbdbi->dirty_lock);
+	fbdbi->blanked = blank != FB_BLANK_UNBLANK;
+	spin_unlock_irq(&fbdbi->dirty_lock);
+
+	/* the worker also picks up pages still on the defio pagelist */
+	if (!fbdbi->blanked)
+		fbdbi_schedule(info);
+
+	return 0;
+}
+
+static int fbdbi_worker_set_priority(struct fbdbi *fbdbi, u32 prio)
+{
+	struct sched_param param = { .sched_priority = prio };
+
+	if (prio >= MAX_USER_RT_PRIO)
+		return -EINVAL;
+
+	return sched_setscheduler(fbdbi->worker_task,
+				  prio ? SCHED_FIFO : SCHED_NORMAL, &param);
+}
+
+static int fbdbi_worker_set_cpu(struct fbdbi *fbdbi, int cpu)
+{
+	if (cpu < 0)
+		return set_cpus_allowed_ptr(fbdbi->worker_task,
+					    cpu_possible_mask);
+
+	if (cpu >= nr_cpu_ids || !cpu_online(cpu))
+		return -EINVAL;
+
+	return set_cpus_allowed_ptr(fbdbi->worker_task, cpumask_of(cpu));
+}
+
+static int fbdbi_worker_start(struct fb_info *info)
+{
+	struct fbdbi *fbdbi = info->par;
+	int ret;
+
+	fbdbi->worker_task = kthread_run(kthread_worker_fn, &fbdbi->worker,
+					 "fbdbi-%s", dev_name(info->device));
+	if (IS_ERR(fbdbi->worker_task)) {
+		ret = PTR_ERR(fbdbi->worker_task);
+		fbdbi->worker_task = NULL;
+		return ret;
+	}
+
+	ret = fbdbi_worker_set_priority(fbdbi, fbdbi->rt_priority);
+	if (!ret)
+		ret = fbdbi_worker_set_cpu(fbdbi, fbdbi->cpu);
+	if (ret) {
+		kthread_stop(fbdbi->worker_task);
+		fbdbi->worker_task = NULL;
+	}
+
+	return ret;
+}
+
+static void fbdbi_worker_stop(struct fbdbi *fbdbi)
+{
+	if (!fbdbi->worker_task)
+		return;
+
+	flush_kthread_worker(&fbdbi->worker);
+	kthread_stop(fbdbi->worker_task);
+	fbdbi->worker_task = NULL;
+}
+
+/*
+ * The new front buffer is latched at the start of the next flush,
+ * so a flip never changes buffer in the middle of a transfer.
+ */
+static int fbdbi_fb_pan_display(struct fb_var_screeninfo *var,
+				struct fb_info *info)
+{
+	struct fbdbi *fbdbi = info->par;
+
+	/*
+	 * Hardware scroll: video memory lines map 1:1 to GRAM lines and the
+	 * controller starts showing them at yoffset. Nothing is resent,
+	 * fbcon only draws the new line.
+	 */
+	if (var->vmode & FB_VMODE_YWRAP) {
+		if (!fbdbi->ywrap || var->xoffset ||
+		    var->yoffset >= info->var.yres)
+			return -EINVAL;
+
+		spin_lock_irq(&fbdbi->dirty_lock);
+		fbdbi->scroll_line = var->yoffset;
+		fbdbi->scroll_pending = true;
+		spin_unlock_irq(&fbdbi->dirty_lock);
+
+		fbdbi_latency_start(fbdbi);
+		fbdbi_idle_kick(fbdbi);
+		fbdbi_schedule(info);
+
+		return 0;
+	}
+
+	if (var->xoffset || var->yoffset + info->var.yres > info->var.yres_virtual)
+		return -EINVAL;
+
+	/* all buffers are already in GRAM, only the scroll start changes */
+	if (fbdbi->gram_flip) {
+		spin_lock_irq(&fbdbi->dirty_lock);
+		fbdbi->scroll_line = var->yoffset;
+		fbdbi->scroll_pending = true;
+		spin_unlock_irq(&fbdbi->dirty_lock);
+
+		fbdbi_latency_start(fbdbi);
+		fbdbi_idle_kick(fbdbi);
+		fbdbi_schedule(info);
+
+		return 0;
+	}
+
+	spin_lock_irq(&fbdbi->dirty_lock);
+	fbdbi->pan_yoffset = var->yoffset;
+	/* a plain pan undoes an earlier ywrap */
+	if (fbdbi->scroll_line) {
+		fbdbi->scroll_line = 0;
+		fbdbi->scroll_pending = true;
+	}
+	spin_unlock_irq(&fbdbi->dirty_lock);
+
+	fbdbi_mkdirty(info, 0, var->yoffset, info->var.xres, info->var.yres);
+
+	return 0;
+}
+
+static bool fbdbi_flush_pending(struct fb_info *info)
+{
+	struct fbdbi *fbdbi = info->par;
+	bool pending;
+
+	spin_lock_irq(&fbdbi->dirty_lock);
+	pending = fbdbi->flushing ||
+		  (!fbdbi->blanked && (fbdbi->damage.num ||
+		   hrtimer_active(&fbdbi->flush_timer) ||
+		   delayed_work_pending(&info->deferred_work)));
+	spin_unlock_irq(&fbdbi->dirty_lock);
+
+	return pending;
+}
+
+static u64 fbdbi_flush_seq(struct fbdbi *fbdbi, ktime_t *time)
+{
+	u64 seq;
+
+	spin_lock_irq(&fbdbi->dirty_lock);
+	seq = fbdbi->flush_seq;
+	if (time)
+		*time = fbdbi->flush_time;
+	spin_unlock_irq(&fbdbi->dirty_lock);
+
+	return seq;
+}
+
+/*
+ * Wait for flush seq to complete. seq 0 waits for the pending flush,
+ * or returns at once if nothing is pending.
+ */
+static int fbdbi_wait_for_flush(struct fb_info *info, u64 seq,
+				unsigned timeout_ms)
+{
+	struct fbdbi *fbdbi = info->par;
+	long ret;
+
+	if (!seq) {
+		if (!fbdbi_flush_pending(info))
+			return 0;
+		seq = fbdbi_flush_seq(fbdbi, NULL) + 1;
+	}
+
+	ret = wait_event_interruptible_timeout(fbdbi->flush_wait,
+					       fbdbi_flush_seq(fbdbi, NULL) >= seq,
+					       msecs_to_jiffies(timeout_ms));
+	if (ret < 0)
+		return ret;
+	if (!ret)
+		return -ETIMEDOUT;
+
+	return 0;
+}
+
+static int fbdbi_ioctl_wait_flush(struct fb_info *info, void __user *argp)
+{
+	struct fbdbi *fbdbi = info->par;
+	struct fbdbi_wait_flush wait;
+	ktime_t time;
+	int ret;
+
+	if (copy_from_user(&wait, argp, sizeof(wait)))
+		return -EFAULT;
+
+	ret = fbdbi_wait_for_flush(info, wait.seq,
+				   wait.timeout_ms ? : 1000);
+	if (ret)
+		return ret;
+
+	wait.seq = fbdbi_flush_seq(fbdbi, &time);
+	wait.timestamp_ns = ktime_to_ns(time);
+
+	if (copy_to_user(argp, &wait, sizeof(wait)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static int fbdbi_ioctl_dirty(struct fb_info *info, void __user *argp)
+{
+	struct fbdbi *fbdbi = info->par;
+	struct fbdbi_clip_rect *clips, *clip;
+	struct fbdbi_dirty dirty;
+	int i, ret = 0;
+
+	if (copy_from_user(&dirty, argp, sizeof(dirty)))
+		return -EFAULT;
+
+	if (dirty.flags || dirty.num_clips > FBDBI_DIRTY_MAX_CLIPS)
+		return -EINVAL;
+
+	if (!dirty.num_clips) {
+		fbdbi_mkdirty(info, 0, fbdbi->pan_yoffset, info->var.xres,
+			      info->var.yres);
+		return 0;
+	}
+
+	clips = kmalloc_array(dirty.num_clips, sizeof(*clips), GFP_KERNEL);
+	if (!clips)
+		return -ENOMEM;
+
+	if (copy_from_user(clips, (void __user *)(uintptr_t)dirty.clips_ptr,
+			   dirty.num_clips * sizeof(*clips))) {
+		ret = -EFAULT;
+		goto out;
+	}
+
+	for (i = 0; i < dirty.num_clips; i++) {
+		clip = &clips[i];
+		if (clip->x1 > clip->x2 || clip->y1 > clip->y2 ||
+		    clip->x2 > info->var.xres_virtual ||
+		    clip->y2 > info->var.yres_virtual) {
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
+	for (i = 0; i < dirty.num_clips; i++) {
+		clip = &clips[i];
+		fbdbi_mkdirty(info, clip->x1, clip->y1, clip->x2 - clip->x1,
+			      clip->y2 - clip->y1);
+	}
+out:
+	kfree(clips);
+
+	return ret;
+}
+
+#define FBDBI_OVERLAY_FLAGS	(FBDBI_OVERLAY_ENABLE | \
+				 FBDBI_OVERLAY_COLORKEY | \
+				 FBDBI_OVERLAY_ALPHA)
+
+static int fbdbi_ioctl_overlay(struct fb_info *info, void __user *argp)
+{
+	struct fbdbi *fbdbi = info->par;
+	unsigned cpp = info->var.bits_per_pixel / 8;
+	struct fbdbi_rect old = { .xs = 1, .xe = 0, };
+	struct fbdbi_overlay ov;
+	struct fbdbi_rect rect;
+	u8 *buf = NULL;
+	size_t size;
+
+	if (copy_from_user(&ov, argp, sizeof(ov)))
+		return -EFAULT;
+
+	if (ov.flags & ~FBDBI_OVERLAY_FLAGS || ov.alpha > 255 || ov.pad)
+		return -EINVAL;
+
+	if (info->var.bits_per_pixel < 16 ||
+	    fbdbi_sw_rotated(fbdbi->display))
+		return -EINVAL;
+
+	rect.xs = ov.x;
+	rect.xe = ov.x + ov.width - 1;
+	rect.ys = ov.y;
+	rect.ye = ov.y + ov.height - 1;
+
+	if (ov.flags & FBDBI_OVERLAY_ENABLE) {
+		if (!ov.width || !ov.height ||
+		    ov.x + ov.width > info->var.xres ||
+		    ov.y + ov.height > info->var.yres)
+			return -EINVAL;
+
+		if (ov.data_ptr) {
+			size = ov.width * ov.height * cpp;
+			buf = vmalloc(size);
+			if (!buf)
+				return -ENOMEM;
+			if (copy_from_user(buf,
+					   (void __user *)(uintptr_t)ov.data_ptr,
+					   size)) {
+				vfree(buf);
+				return -EFAULT;
+			}
+		}
+	}
+
+	mutex_lock(&fbdbi->overlay_lock);
+	if (fbdbi->overlay)
+		old = fbdbi->overlay_rect;
+
+	if (ov.flags & FBDBI_OVERLAY_ENABLE) {
+		/* moving the overlay needs the same size */
+		if (!buf && (!fbdbi->overlay ||
+			     ov.width != old.xe - old.xs + 1 ||
+			     ov.height != old.ye - old.ys + 1)) {
+			mutex_unlock(&fbdbi->overlay_lock);
+			return -EINVAL;
+		}
+		if (buf)
+			swap(buf, fbdbi->overlay);
+		fbdbi->overlay_rect = rect;
+		fbdbi->overlay_flags = ov.flags;
+		fbdbi->overlay_colorkey = ov.colorkey;
+		fbdbi->overlay_alpha = ov.alpha;
+	} else {
+		swap(buf, fbdbi->overlay);
+	}
+	mutex_unlock(&fbdbi->overlay_lock);
+	vfree(buf);
+
+	/* the primary framebuffer hasn't changed, bypass the shadow compare */
+	fbdbi->shadow_valid = false;
+	if (!fbdbi_rect_empty(&old))
+		fbdbi_mkdirty(info, old.xs, fbdbi->pan_yoffset + old.ys,
+			      old.xe - old.xs + 1, old.ye - old.ys + 1);
+	if (ov.flags & FBDBI_OVERLAY_ENABLE)
+		fbdbi_mkdirty(info, rect.xs, fbdbi->pan_yoffset + rect.ys,
+			      ov.width, ov.height);
+
+	return 0;
+}
+
+static int fbdbi_fb_ioctl(struct fb_info *info, unsigned int cmd,
+			  unsigned long arg)
+{
+	struct fbdbi *fbdbi = info->par;
+	void __user *argp = (void __user *)arg;
+	u32 val;
+
+	switch (cmd) {
+	case FBIO_WAITFORVSYNC:
+		if (get_user(val, (u32 __user *)argp))
+			return -EFAULT;
+		if (val)
+			return -EINVAL;
+		return fbdbi_wait_for_flush(info, 0, 1000);
+	case FBDBI_IOCTL_WAIT_FLUSH:
+		return fbdbi_ioctl_wait_flush(info, argp);
+	case FBDBI_IOCTL_DIRTY:
+		return fbdbi_ioctl_dirty(info, argp);
+	case FBDBI_IOCTL_SET_OVERLAY:
+		return fbdbi_ioctl_overlay(info, argp);
+	case FBDBI_IOCTL_SET_TRACKING:
+		if (get_user(val, (u32 __user *)argp))
+			return -EFAULT;
+		if (val != FBDBI_TRACKING_OFF && val != FBDBI_TRACKING_ON)
+			return -EINVAL;
+		fbdbi->untracked_mmap = val == FBDBI_TRACKING_OFF;
+		return 0;
+	default:
+		return -ENOTTY;
+	}
+}
+
+static int fbdbi_untracked_fault(struct vm_area_struct *vma,
+				 struct vm_fault *vmf)
+{
+	struct fb_info *info = vma->vm_private_data;
+	unsigned long offset = vmf->pgoff << PAGE_SHIFT;
+	struct page *page;
+
+	if (offset >= info->fix.smem_len)
+		return VM_FAULT_SIGBUS;
+
+	if (is_vmalloc_addr(info->screen_base + offset))
+		page = vmalloc_to_page(info->screen_base + offset);
+	else
+		page = virt_to_page(info->screen_base + offset);
+	if (!page)
+		return VM_FAULT_SIGBUS;
+
+	get_page(page);
+	vmf->page = page;
+
+	return 0;
+}
+
+/* No page_mkwrite, so writes are not write protected and tracked */
+static const struct vm_operations_struct fbdbi_untracked_vm_ops = {
+	.fault = fbdbi_untracked_fault,
+};
+
+static int fbdbi_fb_mmap(struct fb_info *info, struct vm_area_struct *vma)
+{
+	struct fbdbi *fbdbi = info->par;
+
+	if (!fbdbi->untracked_mmap)
+		return fbdbi->defio_mmap(info, vma);
+
+	vma->vm_ops = &fbdbi_untracked_vm_ops;
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+	vma->vm_private_data = info;
+
+	return 0;
+}
+
+/*
+    unregister_framebuffer() calls put_fb_info(fb_info)
+    fb_destroy is called i ref is zero
+ */
+static int fbdbi_fb_open(struct fb_info *info, int user)
+{
+	struct fbdbi *fbdbi = info->par;
+	int ret;
+
+	mutex_lock(&fbdbi->vmem_lock);
+	ret = fbdbi_vmem_get(info);
+	if (ret >= 0)
+		fbdbi->open_count++;
+	mutex_unlock(&fbdbi->vmem_lock);
+	if (ret < 0)
+		return ret;
+
+	/* the panel still shows what was there before the memory was freed */
+	if (ret)
+		fbdbi_mkdirty(info, 0, fbdbi->pan_yoffset, info->var.xres,
+			      info->var.yres);
+
+	return 0;
+}
+
+static int fbdbi_fb_release(struct fb_info *info, int user)
+{
+	struct fbdbi *fbdbi = info->par;
+
+	mutex_lock(&fbdbi->vmem_lock);
+	fbdbi->open_count--;
+	if (!fbdbi->open_count && fbdbi->display->lazy_vmem)
+		queue_kthread_work(&fbdbi->worker, &fbdbi->release_work);
+	mutex_unlock(&fbdbi->vmem_lock);
+
+	fbdbi_idle_kick(fbdbi);
+
+	return 0;
+}
+
+static void fbdbi_fb_destroy(struct fb_info *info)
+{
+	struct fbdbi *fbdbi = info->par;
+	struct fbdbi_display *display = fbdbi->display;
+
+pr_info("%s()\n", __func__);
+	debugfs_remove_recursive(fbdbi->debugfs);
+	spin_lock_irq(&fbdbi->dirty_lock);
+	fbdbi->stopped = true;
+	spin_unlock_irq(&fbdbi->dirty_lock);
+	hrtimer_cancel(&fbdbi->flush_timer);
+	del_timer_sync(&fbdbi->idle_timer);
+	flush_kthread_worker(&fbdbi->worker);
+	/* released video memory was already cleaned up by fbdbi_release_buffers() */
+	if (info->screen_base)
+		fb_deferred_io_cleanup(info);
+	else
+		cancel_delayed_work_sync(&info->deferred_work);
+	fbdbi_worker_stop(fbdbi);
+	vfree(fbdbi->txbuf);
+	if (display->lazy_vmem)
+		vfree((void __force *)info->screen_base);
+	fb_dealloc_cmap(&info->cmap);
+	vfree(fbdbi->overlay);
+	if (display->backlight) {
+		display->backlight->props.brightness = 0;
+		backlight_update_status(display->backlight);
+	}
+
+	if (display->poweroff)
+		display->poweroff(display);
+}
+
+static const struct fb_ops fbdbi_fb_ops = {
+//	.owner =          THIS_MODULE,
+	.fb_open =        fbdbi_fb_open,
+	.fb_release =     fbdbi_fb_release,
+	.fb_read =        fb_sys_read,
+	.fb_write =       fbdbi_fb_write,
+	.fb_check_var =   fbdbi_fb_check_var,
+	.fb_set_par =     fbdbi_fb_set_par,
+	.fb_setcolreg =   fbdbi_fb_setcolreg,
+	.fb_setcmap =     fbdbi_fb_setcmap,
+	.fb_blank =       fbdbi_fb_blank,
+	.fb_pan_display = fbdbi_fb_pan_display,
+	.fb_ioctl =       fbdbi_fb_ioctl,
+	.fb_fillrect =    fbdbi_fb_fillrect,
+	.fb_copyarea =    fbdbi_fb_copyarea,
+	.fb_imageblit =   fbdbi_fb_imageblit,
+//	.fb_cursor =      fbdbi_fb_cursor,
+//	.fb_rotate =      fbdbi_fb_rotate,
+//	.fb_sync =        fbdbi_fb_sync,
+	.fb_destroy =     fbdbi_fb_destroy,
+};
+
+
+
+static int fbdbi_debugfs_shadow_show(struct seq_file *m, void *v)
+{
+	struct fbdbi *fbdbi = m->private;
+
+	seq_printf(m, "frames: %llu\n", fbdbi->shadow_stats.frames);
+	seq_printf(m, "damaged: %llu bytes\n", fbdbi->shadow_stats.damaged);
+	seq_printf(m, "sent: %llu bytes\n", fbdbi->shadow_stats.sent);
+	seq_printf(m, "saved: %llu bytes\n",
+		   fbdbi->shadow_stats.damaged - fbdbi->shadow_stats.sent);
+	seq_printf(m, "last frame: damaged %u, sent %u, saved %u bytes\n",
+		   fbdbi->shadow_stats.last_damaged,
+		   fbdbi->shadow_stats.last_sent,
+		   fbdbi->shadow_stats.last_damaged -
+		   fbdbi->shadow_stats.last_sent);
+
+	return 0;
+}
+
+static int fbdbi_debugfs_shadow_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, fbdbi_debugfs_shadow_show, inode->i_private);
+}
+
+static const struct file_operations fbdbi_debugfs_shadow_fops = {
+	.open = fbdbi_debugfs_shadow_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int fbdbi_debugfs_pacing_show(struct seq_file *m, void *v)
+{
+	struct fbdbi *fbdbi = m->private;
+
+	seq_printf(m, "period: %llu ns\n", fbdbi_sched_period(fbdbi));
+	seq_printf(m, "flushes: %llu\n", fbdbi->pacing_stats.flushes);
+	seq_printf(m, "missed: %llu\n", fbdbi->pacing_stats.missed);
+	seq_printf(m, "last late: %lld ns\n", fbdbi->pacing_stats.last_late);
+	seq_printf(m, "max late: %lld ns\n", fbdbi->pacing_stats.max_late);
+	if (fbdbi->te) {
+		seq_printf(m, "te period: %llu ns\n", fbdbi->te_period);
+		seq_printf(m, "te count: %llu\n", fbdbi->te_count);
+		seq_printf(m, "te timeouts: %llu\n", fbdbi->te_timeouts);
+		seq_printf(m, "write rate: %llu bytes/s\n", fbdbi->write_rate);
+	}
+
+	return 0;
+}
+
+static int fbdbi_debugfs_pacing_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, fbdbi_debugfs_pacing_show, inode->i_private);
+}
+
+static const struct file_operations fbdbi_debugfs_pacing_fops = {
+	.open = fbdbi_debugfs_pacing_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int fbdbi_debugfs_latency_show(struct seq_file *m, void *v)
+{
+	struct fbdbi *fbdbi = m->private;
+	u64 count = fbdbi->latency_stats.count;
+	int i, last = -1;
+
+	seq_printf(m, "fps: %u.%u\n", fbdbi->latency_stats.fps_x10 / 10,
+		   fbdbi->latency_stats.fps_x10 % 10);
+	seq_printf(m, "samples: %llu\n", count);
+	seq_printf(m, "average: %llu us\n",
+		   count ? div64_u64(fbdbi->latency_stats.sum, count) : 0);
+	seq_printf(m, "max: %llu us\n", fbdbi->latency_stats.max);
+
+	for (i = 0; i < FBDBI_LATENCY_BUCKETS; i++)
+		if (fbdbi->latency_stats.hist[i])
+			last = i;
+
+	for (i = 0; i <= last; i++) {
+		if (i == FBDBI_LATENCY_BUCKETS - 1)
+			seq_printf(m, "%8lu -      inf us: %llu\n",
+				   i ? 1UL << i : 0, fbdbi->latency_stats.hist[i]);
+		else
+			seq_printf(m, "%8lu - %8lu us: %llu\n",
+				   i ? 1UL << i : 0, (2UL << i) - 1,
+				   fbdbi->latency_stats.hist[i]);
+	}
+
+	return 0;
+}
+
+static int fbdbi_debugfs_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, fbdbi_debugfs_latency_show, inode->i_private);
+}
+
+static const struct file_operations fbdbi_debugfs_latency_fops = {
+	.open = fbdbi_debugfs_latency_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void fbdbi_debugfs_init(struct fbdbi *fbdbi)
+{
+	struct fb_info *info = fbdbi->display->info;
+
+	if (!fbdbi_debugfs_root)
+		return;
+
+	fbdbi->debugfs = debugfs_create_dir(dev_name(info->dev),
+					    fbdbi_debugfs_root);
+	if (!fbdbi->debugfs) {
+		dev_warn(info->dev, "Failed to create debugfs directory\n");
+		return;
+	}
+
+	debugfs_create_file("pacing", 0440, fbdbi->debugfs, fbdbi,
+			    &fbdbi_debugfs_pacing_fops);
+	debugfs_create_file("latency", 0440, fbdbi->debugfs, fbdbi,
+			    &fbdbi_debugfs_latency_fops);
+	if (fbdbi->shadow)
+		debugfs_create_file("shadow", 0440, fbdbi->debugfs, fbdbi,
+				    &fbdbi_debugfs_shadow_fops);
+}
+
+static ssize_t sched_show(struct device *dev, struct device_attribute *attr,
+			  char *buf)
+{
+	struct fb_info *info = dev_get_drvdata(dev);
+	struct fbdbi *fbdbi = info->par;
+
+	return sprintf(buf, "%s\n", fbdbi_sched_names[fbdbi->sched]);
+}
+
+static ssize_t sched_store(struct device *dev, struct device_attribute *attr,
+			   const char *buf, size_t count)
+{
+	struct fb_info *info = dev_get_drvdata(dev);
+	struct fbdbi *fbdbi = info->par;
+	int sched;
+
+	sched = fbdbi_sched_parse(buf);
+	if (sched < 0)
+		return sched;
+
+	fbdbi->sched = sched;
+	fbdbi->next_flush = ktime_get();
+	fbdbi_mkdirty(info, 0, 0, info->var.xres, info->var.yres);
+
+	return count;
+}
+static DEVICE_ATTR_RW(sched);
+
+static ssize_t fps_show(struct device *dev, struct device_attribute *attr,
+			char *buf)
+{
+	struct fb_info *info = dev_get_drvdata(dev);
+	struct fbdbi *fbdbi = info->par;
+
+	return sprintf(buf, "%u\n", fbdbi->fps);
+}
+
+static ssize_t fps_store(struct device *dev, struct device_attribute *attr,
+			 const char *buf, size_t count)
+{
+	struct fb_info *info = dev_get_drvdata(dev);
+	struct fbdbi *fbdbi = info->par;
+	unsigned fps;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &fps);
+	if (ret)
+		return ret;
+
+	if (!fps)
+		return -EINVAL;
+
+	fbdbi->fps = fps;
+
+	return count;
+}
+static DEVICE_ATTR_RW(fps);
+
+static ssize_t min_interval_us_show(struct device *dev,
+				    struct device_attribute *attr, char *buf)
+{
+	struct fb_info *info = dev_get_drvdata(dev);
+	struct fbdbi *fbdbi = info->par;
+
+	return sprintf(buf, "%u\n", fbdbi->min_interval);
+}
+
+static ssize_t min_interval_us_store(struct device *dev,
+				     struct device_attribute *attr,
+				     const char *buf, size_t count)
+{
+	struct fb_info *info = dev_get_drvdata(dev);
+	struct fbdbi *fbdbi = info->par;
+	unsigned val;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &val);
+	if (ret)
+		return ret;
+
+	fbdbi->min_interval = val;
+
+	return count;
+}
+static DEVICE_ATTR_RW(min_interval_us);
+
+static ssize_t rt_priority_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct fb_info *info = dev_get_drvdata(dev);
+	struct fbdbi *fbdbi = info->par;
+
+	return sprintf(buf, "%u\n", fbdbi->rt_priority);
+}
+
+static ssize_t rt_priority_store(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct fb_info *info = dev_get_drvdata(dev);
+	struct fbdbi *fbdbi = info->par;
+	unsigned prio;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &prio);
+	if (ret)
+		return ret;
+
+	ret = fbdbi_worker_set_priority(fbdbi, prio);
+	if (ret)
+		return ret;
+
+	fbdbi->rt_priority = prio;
+
+	return count;
+}
+static DEVICE_ATTR_RW(rt_priority);
+
+static ssize_t cpu_show(struct device *dev, struct device_attribute *attr,
+			char *buf)
+{
+	struct fb_info *info = dev_get_drvdata(dev);
+	struct fbdbi *fbdbi = info->par;
+
+	return sprintf(buf, "%d\n", fbdbi->cpu);
+}
+
+static ssize_t cpu_store(struct device *dev, struct device_attribute *attr,
+			 const char *buf, size_t count)
+{
+	struct fb_info *info = dev_get_drvdata(dev);
+	struct fbdbi *fbdbi = info->par;
+	int cpu;
+	int ret;
+
+	ret = kstrtoint(buf, 10, &cpu);
+	if (ret)
+		return ret;
+
+	ret = fbdbi_worker_set_cpu(fbdbi, cpu);
+	if (ret)
+		return ret;
+
+	fbdbi->cpu = cpu < 0 ? -1 : cpu;
+
+	return count;
+}
+static DEVICE_ATTR_RW(cpu);
+
+static ssize_t flush_seq_show(struct device *dev,
+			      struct device_attribute *attr, char *buf)
+{
+	struct fb_info *info = dev_get_drvdata(dev);
+	ktime_t time;
+	u64 seq;
+
+	seq = fbdbi_flush_seq(info->par, &time);
+
+	return sprintf(buf, "%llu %lld\n", seq, ktime_to_ns(time));
+}
+static DEVICE_ATTR_RO(flush_seq);
+
+static struct attribute *fbdbi_attrs[] = {
+	&dev_attr_sched.attr,
+	&dev_attr_fps.attr,
+	&dev_attr_min_interval_us.attr,
+	&dev_attr_rt_priority.attr,
+	&dev_attr_cpu.attr,
+	&dev_attr_flush_seq.attr,
+	NULL,
+};
+
+static const struct attribute_group fbdbi_attr_group = {
+	.attrs = fbdbi_attrs,
+};
+
+/* the attributes are removed with the fb device on unregister */
+static int fbdbi_sysfs_init(struct fb_info *info)
+{
+	return sysfs_create_group(&info->dev->kobj, &fbdbi_attr_group);
+}
+
+struct fbdbi_dma_vmem {
+	struct device *dev;
+	void *vmem;
+	size_t size;
+	dma_addr_t dma;
+};
+
+static void fbdbi_free_dma_vmem(void *data)
+{
+	struct fbdbi_dma_vmem *res = data;
+
+	dma_unmap_single(res->dev, res->dma, res->size, DMA_TO_DEVICE);
+	free_pages_exact(res->vmem, res->size);
+}
+
+/*
+ * Physically contiguous, cacheable video memory that is DMA mapped for
+ * the lifetime of the device. Transfers only need a cache sync.
+ */
+static void *fbdbi_alloc_dma_vmem(struct device *dev, struct fbdbi *fbdbi,
+				  size_t size)
+{
+	struct fbdbi_dma_vmem *res;
+	int ret;
+
+	res = devm_kzalloc(dev, sizeof(*res), GFP_KERNEL);
+	if (!res)
+		return ERR_PTR(-ENOMEM);
+
+	size = PAGE_ALIGN(size);
+	res->vmem = alloc_pages_exact(size, GFP_KERNEL | __GFP_ZERO);
+	if (!res->vmem)
+		return ERR_PTR(-ENOMEM);
+
+	res->dev = dev;
+	res->size = size;
+	res->dma = dma_map_single(dev, res->vmem, size, DMA_TO_DEVICE);
+	if (dma_mapping_error(dev, res->dma)) {
+		free_pages_exact(res->vmem, size);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	ret = devm_add_action(dev, fbdbi_free_dma_vmem, res);
+	if (ret) {
+		fbdbi_free_dma_vmem(res);
+		return ERR_PTR(ret);
+	}
+
+	fbdbi->vmem_dma = res->dma;
+
+	return res->vmem;
+}
+
+int devm_fbdbi_init(struct device *dev, struct fbdbi_display *display)
 {
 	struct fb_info *info;
 	struct fbdbi *fbdbi;
@@ -518,6 +2591,16 @@ pr_info("%s(xres=%u, yres=%u)\n", __func__, display->xres, display->yres);
 	fbdbi = info->par;
 	fbdbi->display = display;
 	display->info = info;
+	spin_lock_init(&fbdbi->dirty_lock);
+	init_waitqueue_head(&fbdbi->flush_wait);
+	mutex_init(&fbdbi->overlay_lock);
+	mutex_init(&fbdbi->vmem_lock);
+	init_kthread_worker(&fbdbi->worker);
+	init_kthread_work(&fbdbi->flush_work, fbdbi_flush_work);
+	init_kthread_work(&fbdbi->idle_work, fbdbi_idle_work);
+	init_kthread_work(&fbdbi->release_work, fbdbi_release_work);
+	setup_timer(&fbdbi->idle_timer, fbdbi_idle_timer, (unsigned long)fbdbi);
+	fbdbi->cpu = -1;
 
 	info->fbops = devm_kmalloc(dev, sizeof(*info->fbops), GFP_KERNEL);
 	if (!info->fbops)
@@ -578,23 +2661,82 @@ pr_info("%s(xres=%u, yres=%u)\n", __func__, display->xres, display->yres);
 		info->var.blue.offset = 0;
 		info->var.blue.length = 8;
 		break;
+	case FBDBI_FORMAT_C8:
+		info->var.bits_per_pixel = 8;
+		info->fix.visual = FB_VISUAL_PSEUDOCOLOR;
+		info->var.red.length = 8;
+		info->var.green.length = 8;
+		info->var.blue.length = 8;
+		if (fb_alloc_cmap(&info->cmap, 256, 0))
+			return -ENOMEM;
+		break;
+	case FBDBI_FORMAT_I420:
+	case FBDBI_FORMAT_NV12:
+		/* 2x2 subsampled chroma, one buffer */
+		if (display->xres % 2 || display->yres % 2 ||
+		    display->buffers > 1)
+			return -EINVAL;
+		info->var.bits_per_pixel = 12;
+		vmem_size = vmem_size * 3 / 2;
+		info->fix.visual = FB_VISUAL_FOURCC;
+		info->fix.capabilities = FB_CAP_FOURCC;
+		info->var.grayscale = display->format == FBDBI_FORMAT_I420 ?
+				      V4L2_PIX_FMT_YUV420 : V4L2_PIX_FMT_NV12;
+		break;
 	default:
 		return -EINVAL;
 	}
-	vmem = devm_vzalloc(dev, vmem_size);
-	if (!vmem)
-		return -ENOMEM;
 
-	info->screen_base = (u8 __force __iomem *)vmem;
-	info->fix.smem_len = vmem_size;
+	if (!display->buffers)
+		display->buffers = 1;
+	info->var.yres_virtual = info->var.yres * display->buffers;
+	if (display->buffers > 1)
+		info->fix.ypanstep = 1;
+
 // also set in set_par
 	info->fix.line_length = vmem_size / display->yres;
+	/* the luma plane stride */
+	if (fbdbi_format_is_yuv(display->format))
+		info->fix.line_length = display->xres;
+	vmem_size *= display->buffers;
+
+	if (display->dma_vmem) {
+		display->lazy_vmem = false;
+		vmem = fbdbi_alloc_dma_vmem(dev, fbdbi, vmem_size);
+		if (IS_ERR(vmem))
+			return PTR_ERR(vmem);
+	} else if (display->lazy_vmem) {
+		/* allocated on first open by fbdbi_vmem_get() */
+		vmem = NULL;
+	} else {
+		vmem = devm_vzalloc(dev, vmem_size);
+		if (!vmem)
+			return -ENOMEM;
+	}
+
+	info->screen_base = (u8 __force __iomem *)vmem;
+	info->fix.smem_len = vmem_size;
+	/* fb_deferred_io looks up non-vmalloc pages through smem_start */
+	if (display->dma_vmem)
+		info->fix.smem_start = virt_to_phys(vmem);
 
 	info->fbdefio = devm_kzalloc(dev, sizeof(*info->fbdefio), GFP_KERNEL);
 	if (!info->fbdefio)
 		return -ENOMEM;
 
-	info->fbdefio->delay = HZ / 20;
+	if (!display->update_cost)
+		display->update_cost = FBDBI_UPDATE_COST;
+
+	fbdbi->sched = FBDBI_SCHED_AUTO;
+	fbdbi->fps = FBDBI_DEFAULT_FPS;
+	hrtimer_init(&fbdbi->flush_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	fbdbi->flush_timer.function = fbdbi_flush_timer;
+	fbdbi->next_flush = ktime_get();
+	fbdbi->deadline = fbdbi->next_flush;
+
+	/* flushes are paced by the flush timer, this is only a fallback */
+	info->fbdefio->delay = HZ;
+	info->fbdefio->first_io = fbdbi_first_io;
 	info->fbdefio->deferred_io = fbdbi_deferred_io;
 
 	return 0;
@@ -603,11 +2745,16 @@ EXPORT_SYMBOL(devm_fbdbi_init);
 
 int devm_fbdbi_register(struct fbdbi_display *display)
 {
+	struct fbdbi *fbdbi = display->info->par;
+	struct fbdbi_rect full;
 	int ret;
 
 pr_info("%s()\n", __func__);
 
 	fb_deferred_io_init(display->info);
+	/* fb_deferred_io_init() sets fb_mmap */
+	fbdbi->defio_mmap = display->info->fbops->fb_mmap;
+	display->info->fbops->fb_mmap = fbdbi_fb_mmap;
 
 	if (!display->initialized) {
 		if (display->poweron) {
@@ -622,7 +2769,7 @@ pr_info("%s()\n", __func__);
 				return ret;
 		}
 
-		if (display->rotate) {
+		if (display->rotate || display->sw_rotate) {
 			ret = fbdbi_fb_check_var(&display->info->var,
 							display->info);
 			if (ret)
@@ -632,12 +2779,41 @@ pr_info("%s()\n", __func__);
 			if (ret)
 				return ret;
 		}
-		ret = display->update(display, 0, display->info->var.yres - 1);
+		full.xs = 0;
+		full.xe = display->info->var.xres - 1;
+		full.ys = 0;
+		full.ye = display->info->var.yres - 1;
+		mutex_lock(&fbdbi->vmem_lock);
+		ret = fbdbi_vmem_get(display->info);
+		mutex_unlock(&fbdbi->vmem_lock);
+		if (ret < 0)
+			return ret;
+		ret = fbdbi_update_rect(display, &full);
+		if (ret)
+			return ret;
+	}
+
+	if (fbdbi->te && display->set_tear) {
+		ret = display->set_tear(display, true);
 		if (ret)
 			return ret;
 	}
 
+	fbdbi_set_scroll_mode(display->info);
+
+	ret = fbdbi_worker_start(display->info);
+	if (ret)
+		return ret;
+
 	ret = devm_register_framebuffer(display->info);
+	if (ret) {
+		fbdbi_worker_stop(fbdbi);
+		return ret;
+	}
+
+	fbdbi_debugfs_init(display->info->par);
+
+	ret = fbdbi_sysfs_init(display->info);
 	if (ret)
 		return ret;
 
@@ -668,28 +2844,162 @@ pr_info("%s()\n", __func__);
 		backlight_update_status(display->backlight);
 	}
 
+	if (fbdbi->sched == FBDBI_SCHED_CONTINUOUS)
+		fbdbi_mkdirty(display->info, 0, 0, display->info->var.xres,
+			      display->info->var.yres);
+	/* fill the back buffers' part of GRAM */
+	if (fbdbi->gram_flip)
+		fbdbi_mkdirty(display->info, 0, display->info->var.yres,
+			      display->info->var.xres,
+			      display->info->var.yres_virtual -
+			      display->info->var.yres);
+	fbdbi_idle_kick(fbdbi);
+	/* drop what the initial update allocated unless someone opened us */
+	if (display->lazy_vmem)
+		queue_kthread_work(&fbdbi->worker, &fbdbi->release_work);
+
 	dev_info(display->info->dev,
-		"%s frame buffer, %dx%d, %d KiB video memory, fps=%lu\n",
+		"%s frame buffer, %dx%d, %d KiB video memory, fps=%u, sched=%s\n",
 		display->info->fix.id, display->info->var.xres, display->info->var.yres,
-		display->info->fix.smem_len >> 10,
-		HZ/display->info->fbdefio->delay);
+		display->info->fix.smem_len >> 10, fbdbi->fps,
+		fbdbi_sched_names[fbdbi->sched]);
 
 	return 0;
 }
 EXPORT_SYMBOL(devm_fbdbi_register);
 
+/* fbdbi-drm is only loaded when a display asks for it */
+static void fbdbi_drm_put(void *data)
+{
+	symbol_put(devm_fbdbi_drm_register_dt);
+}
+
+static int fbdbi_drm_register_dt(struct device *dev, struct fbdbi_display *display)
+{
+	int (*drm_register)(struct device *dev, struct fbdbi_display *display);
+	int ret;
+
+	drm_register = symbol_request(devm_fbdbi_drm_register_dt);
+	if (!drm_register) {
+		dev_err(dev, "fbdbi-drm is not available\n");
+		return -ENODEV;
+	}
+
+	ret = devm_add_action(dev, fbdbi_drm_put, NULL);
+	if (ret) {
+		symbol_put(devm_fbdbi_drm_register_dt);
+		return ret;
+	}
+
+	return drm_register(dev, display);
+}
+
 int devm_fbdbi_register_dt(struct device *dev, struct fbdbi_display *display)
 {
 	struct device_node *backlight;
+	struct fbdbi *fbdbi;
 	int ret;
 
+	if (of_property_read_bool(dev->of_node, "drm"))
+		return fbdbi_drm_register_dt(dev, display);
+
+	display->buffers = fbdbi_of_value(dev, "buffers", display->buffers ? : 1);
+	if (display->buffers < 1 || display->buffers > 3) {
+		dev_err(dev, "buffers must be in the range 1-3\n");
+		return -EINVAL;
+	}
+	display->gram_height = fbdbi_of_value(dev, "gram-height",
+					      display->gram_height);
+	if (display->gram_height && display->gram_height < display->yres) {
+		dev_err(dev, "gram-height is less than the panel height\n");
+		return -EINVAL;
+	}
+	if (of_property_read_bool(dev->of_node, "dma-vmem"))
+		display->dma_vmem = true;
+	if (of_property_read_bool(dev->of_node, "lazy-alloc"))
+		display->lazy_vmem = true;
+	if (display->format == FBDBI_FORMAT_C8 ||
+	    fbdbi_format_is_yuv(display->format)) {
+		display->wire_format = fbdbi_of_format_prop(dev, "wire-format",
+							    display->wire_format);
+		if (display->wire_format &&
+		    display->wire_format != FBDBI_FORMAT_RGB565 &&
+		    display->wire_format != FBDBI_FORMAT_RGB888) {
+			dev_err(dev, "wire-format must be rgb565 or rgb888\n");
+			return -EINVAL;
+		}
+	}
+
 	ret = devm_fbdbi_init(dev, display);
 	if (ret)
 		return ret;
 
+	fbdbi = display->info->par;
+
 	display->info->var.rotate = fbdbi_of_value(dev, "rotate", 0);
+	if (of_property_read_bool(dev->of_node, "sw-rotate"))
+		display->sw_rotate = true;
+	if (fbdbi_format_is_yuv(display->format) && !display->rotate &&
+	    display->info->var.rotate) {
+		dev_err(dev, "YUV formats need hardware rotation\n");
+		return -EINVAL;
+	}
 	display->initialized = of_property_read_bool(dev->of_node,
 						     "initialized");
+	display->update_cost = fbdbi_of_value(dev, "update-cost",
+					      display->update_cost);
+
+	fbdbi->fps = fbdbi_of_value(dev, "fps", fbdbi->fps);
+	if (!fbdbi->fps) {
+		dev_err(dev, "fps can't be zero\n");
+		return -EINVAL;
+	}
+	fbdbi->sched = fbdbi_of_sched(dev, fbdbi->sched);
+	fbdbi->min_interval = fbdbi_of_value(dev, "min-interval-us", 0);
+	fbdbi->rt_priority = fbdbi_of_value(dev, "rt-priority", 0);
+	fbdbi->cpu = fbdbi_of_value(dev, "cpu", fbdbi->cpu);
+	fbdbi->idle_timeout = fbdbi_of_value(dev, "idle-timeout-ms", 0);
+
+	fbdbi->te = devm_gpiod_get_optional(dev, "te", GPIOD_IN);
+	if (IS_ERR(fbdbi->te))
+		return PTR_ERR(fbdbi->te);
+	if (fbdbi->te) {
+		init_completion(&fbdbi->te_complete);
+		ret = devm_request_irq(dev, gpiod_to_irq(fbdbi->te),
+				       fbdbi_te_irq, IRQF_TRIGGER_RISING,
+				       dev_name(dev), fbdbi);
+		if (ret) {
+			dev_err(dev, "failed to request TE irq (%d)\n", ret);
+			return ret;
+		}
+	}
+
+	/* both work on whole lines and would miss chroma changes */
+	if (fbdbi_format_is_yuv(display->format) &&
+	    (of_property_read_bool(dev->of_node, "shadow-buffer") ||
+	     of_property_read_bool(dev->of_node, "snapshot")))
+		dev_warn(dev, "shadow-buffer and snapshot ignored for YUV\n");
+	else if (of_property_read_bool(dev->of_node, "shadow-buffer")) {
+		fbdbi->shadow = devm_vzalloc(dev, display->info->fix.smem_len);
+		if (!fbdbi->shadow)
+			return -ENOMEM;
+	}
+
+	if (!fbdbi_format_is_yuv(display->format) &&
+	    of_property_read_bool(dev->of_node, "snapshot")) {
+		fbdbi->snapshot_size = display->info->fix.smem_len;
+		if (fbdbi->shadow) {
+			fbdbi->snapshot = fbdbi->shadow;
+		} else {
+			/* GRAM flipping sends from every buffer */
+			fbdbi_set_scroll_mode(display->info);
+			if (!fbdbi->gram_flip)
+				fbdbi->snapshot_size /= display->buffers;
+			fbdbi->snapshot = devm_vzalloc(dev, fbdbi->snapshot_size);
+			if (!fbdbi->snapshot)
+				return -ENOMEM;
+		}
+	}
 
 	display->power_supply = devm_regulator_get(dev, "power");
 	if (IS_ERR(display->power_supply))
@@ -708,38 +3018,403 @@ int devm_fbdbi_register_dt(struct device *dev, struct fbdbi_display *display)
 }
 EXPORT_SYMBOL(devm_fbdbi_register_dt);
 
-int fbdbi_display_update(struct fbdbi_display *display, unsigned regnr, unsigned ys, unsigned ye)
+/*
+ * Video memory to send to the display: the snapshot if enabled,
+ * otherwise the front buffer.
+ */
+u8 *fbdbi_display_vmem(struct fbdbi_display *display)
+{
+	struct fb_info *info = display->info;
+	struct fbdbi *fbdbi = info->par;
+
+	if (fbdbi->scanout)
+		return fbdbi->scanout;
+
+	if (fbdbi->snapshot)
+		return fbdbi->snapshot;
+
+	return fbdbi_front_vmem(info);
+}
+EXPORT_SYMBOL(fbdbi_display_vmem);
+
+/*
+ * Fill dst with the panel rectangle xs,ys - xe,ye read from the rotated
+ * framebuffer. The framebuffer offset of panel pixel x,y is
+ * start + x * dx + y * dy. The rectangle is walked in FBDBI_TILE_SIZE
+ * blocks so the column-wise reads from the framebuffer stay within a few
+ * cache lines.
+ */
+#define FBDBI_ROTATE_BLOCK(type)					\
+	do {								\
+		for (y = by; y <= bye; y++) {				\
+			type *d = (type *)dst + (y - ys) * w + bx - xs;	\
+			const u8 *s = src + bx * dx + y * dy;		\
+			for (x = bx; x <= bxe; x++, s += dx)		\
+				*d++ = *(const type *)s;		\
+		}							\
+	} while (0)
+
+static void fbdbi_rotate_rect(struct fbdbi_display *display, u8 *dst,
+			      unsigned xs, unsigned xe, unsigned ys, unsigned ye)
+{
+	struct fb_info *info = display->info;
+	long ll = info->fix.line_length;
+	long cpp = info->var.bits_per_pixel / 8;
+	unsigned w = xe - xs + 1;
+	unsigned bx, by, bxe, bye, x, y;
+	const u8 *src = fbdbi_display_vmem(display);
+	long dx, dy;
+
+	switch (info->var.rotate) {
+	case 90:
+		src += (display->yres - 1) * cpp;
+		dx = ll;
+		dy = -cpp;
+		break;
+	case 180:
+		src += (display->yres - 1) * ll + (display->xres - 1) * cpp;
+		dx = -cpp;
+		dy = -ll;
+		break;
+	case 270:
+	default:
+		src += (display->xres - 1) * ll;
+		dx = -ll;
+		dy = cpp;
+		break;
+	}
+
+	for (by = ys; by <= ye; by += FBDBI_TILE_SIZE) {
+		bye = min(by + FBDBI_TILE_SIZE - 1, ye);
+		for (bx = xs; bx <= xe; bx += FBDBI_TILE_SIZE) {
+			bxe = min(bx + FBDBI_TILE_SIZE - 1, xe);
+			switch (cpp) {
+			case 2:
+				FBDBI_ROTATE_BLOCK(u16);
+				break;
+			case 4:
+				FBDBI_ROTATE_BLOCK(u32);
+				break;
+			default:
+				for (y = by; y <= bye; y++) {
+					u8 *d = dst + ((y - ys) * w + bx - xs) * cpp;
+					const u8 *s = src + bx * dx + y * dy;
+
+					for (x = bx; x <= bxe; x++, s += dx, d += cpp)
+						memcpy(d, s, cpp);
+				}
+				break;
+			}
+		}
+	}
+}
+
+static size_t fbdbi_txbuf_size(struct fbdbi_display *display)
+{
+	struct fb_info *info = display->info;
+
+	if (display->format == FBDBI_FORMAT_C8 ||
+	    fbdbi_format_is_yuv(display->format))
+		return display->xres * display->yres * 4;
+
+	return info->fix.smem_len / display->buffers;
+}
+
+/*
+ * Expand n 8-bit palette indices to wire format through the LUT.
+ * Runs backwards so src and dst can be the same buffer.
+ */
+static void fbdbi_lut_expand(struct fbdbi *fbdbi, u8 *dst, const u8 *src,
+			     unsigned n, unsigned wire_cpp)
+{
+	const u32 *lut = fbdbi->lut;
+	u32 val;
+
+	if (wire_cpp == 2) {
+		u16 *d = (u16 *)dst;
+
+		while (n--)
+			d[n] = lut[src[n]];
+		return;
+	}
+
+	/* RGB888, same byte order as FBDBI_FORMAT_RGB888 video memory */
+	while (n--) {
+		val = lut[src[n]];
+		dst[n * 3] = val;
+		dst[n * 3 + 1] = val >> 8;
+		dst[n * 3 + 2] = val >> 16;
+	}
+}
+
+static inline void fbdbi_put_rgb(u8 *dst, unsigned wire_cpp, int r, int g,
+				 int b)
+{
+	r = clamp(r, 0, 255 << 8);
+	g = clamp(g, 0, 255 << 8);
+	b = clamp(b, 0, 255 << 8);
+
+	if (wire_cpp == 2) {
+		*(u16 *)dst = ((r >> 11) << 11) | ((g >> 10) << 5) | (b >> 11);
+	} else {
+		dst[0] = b >> 8;
+		dst[1] = g >> 8;
+		dst[2] = r >> 8;
+	}
+}
+
+/*
+ * Convert pixels xs..xe of YUV 4:2:0 row y to wire format.
+ * BT.601 limited range in 8.8 fixed point, the chroma terms are
+ * computed once per pixel pair.
+ */
+static void fbdbi_yuv_convert(struct fb_info *info, u8 *dst, const u8 *vmem,
+			      unsigned xs, unsigned xe, unsigned y,
+			      unsigned wire_cpp)
+{
+	struct fbdbi *fbdbi = info->par;
+	unsigned xres = info->var.xres;
+	unsigned luma = xres * info->var.yres;
+	const u8 *py = vmem + y * xres;
+	const u8 *pu, *pv;
+	unsigned step = 1;
+	int c, u, v, rv = 0, guv = 0, bu = 0;
+	unsigned x;
+
+	if (fbdbi->display->format == FBDBI_FORMAT_I420) {
+		pu = vmem + luma + (y / 2) * (xres / 2);
+		pv = pu + luma / 4;
+	} else {
+		/* interleaved UV */
+		pu = vmem + luma + (y / 2) * xres;
+		pv = pu + 1;
+		step = 2;
+	}
+
+	for (x = xs; x <= xe; x++) {
+		if (x == xs || !(x & 1)) {
+			u = pu[x / 2 * step] - 128;
+			v = pv[x / 2 * step] - 128;
+			rv = 409 * v + 128;
+			guv = -100 * u - 208 * v + 128;
+			bu = 516 * u + 128;
+		}
+		c = 298 * (py[x] - 16);
+		fbdbi_put_rgb(dst, wire_cpp, c + rv, c + guv, c + bu);
+		dst += wire_cpp;
+	}
+}
+
+static bool fbdbi_overlay_hit(struct fbdbi *fbdbi, struct fbdbi_rect *rect)
+{
+	struct fbdbi_rect *ov = &fbdbi->overlay_rect;
+
+	return fbdbi->overlay && !fbdbi_sw_rotated(fbdbi->display) &&
+	       ov->xs <= rect->xe && ov->xe >= rect->xs &&
+	       ov->ys <= rect->ye && ov->ye >= rect->ys;
+}
+
+static u32 fbdbi_blend_pixel(u32 dst, u32 src, unsigned cpp, u32 alpha)
+{
+	u32 r, g, b;
+
+	if (cpp == 2) {
+		r = ((src >> 11) * alpha + (dst >> 11) * (255 - alpha)) / 255;
+		g = (((src >> 5) & 0x3f) * alpha +
+		     ((dst >> 5) & 0x3f) * (255 - alpha)) / 255;
+		b = ((src & 0x1f) * alpha + (dst & 0x1f) * (255 - alpha)) / 255;
+		return (r << 11) | (g << 5) | b;
+	}
+
+	/* RGB888 and XRGB8888 have one byte per channel */
+	r = (((src >> 16) & 0xff) * alpha +
+	     ((dst >> 16) & 0xff) * (255 - alpha)) / 255;
+	g = (((src >> 8) & 0xff) * alpha +
+	     ((dst >> 8) & 0xff) * (255 - alpha)) / 255;
+	b = ((src & 0xff) * alpha + (dst & 0xff) * (255 - alpha)) / 255;
+
+	return (r << 16) | (g << 8) | b;
+}
+
+static u32 fbdbi_get_pixel(const u8 *p, unsigned cpp)
+{
+	if (cpp == 2)
+		return *(const u16 *)p;
+	if (cpp == 4)
+		return *(const u32 *)p;
+
+	return p[0] | (p[1] << 8) | (p[2] << 16);
+}
+
+static void fbdbi_put_pixel(u8 *p, unsigned cpp, u32 val)
+{
+	if (cpp == 2) {
+		*(u16 *)p = val;
+	} else if (cpp == 4) {
+		*(u32 *)p = val;
+	} else {
+		p[0] = val;
+		p[1] = val >> 8;
+		p[2] = val >> 16;
+	}
+}
+
+/*
+ * Blend the overlay into buf which holds rect with a stride of the
+ * rect width. Only the overlapping part is touched.
+ */
+static void fbdbi_overlay_blend(struct fbdbi *fbdbi, u8 *buf, unsigned cpp,
+				struct fbdbi_rect *rect)
+{
+	struct fbdbi_rect *ov = &fbdbi->overlay_rect;
+	unsigned xs = max(ov->xs, rect->xs), xe = min(ov->xe, rect->xe);
+	unsigned ys = max(ov->ys, rect->ys), ye = min(ov->ye, rect->ye);
+	unsigned ov_pitch = (ov->xe - ov->xs + 1) * cpp;
+	unsigned pitch = (rect->xe - rect->xs + 1) * cpp;
+	bool colorkey = fbdbi->overlay_flags & FBDBI_OVERLAY_COLORKEY;
+	bool alpha = fbdbi->overlay_flags & FBDBI_OVERLAY_ALPHA;
+	unsigned x, y;
+	const u8 *src;
+	u8 *dst;
+	u32 val;
+
+	for (y = ys; y <= ye; y++) {
+		src = fbdbi->overlay + (y - ov->ys) * ov_pitch +
+		      (xs - ov->xs) * cpp;
+		dst = buf + (y - rect->ys) * pitch + (xs - rect->xs) * cpp;
+		if (!colorkey && !alpha) {
+			memcpy(dst, src, (xe - xs + 1) * cpp);
+			continue;
+		}
+		for (x = xs; x <= xe; x++, src += cpp, dst += cpp) {
+			val = fbdbi_get_pixel(src, cpp);
+			if (colorkey && val == fbdbi->overlay_colorkey)
+				continue;
+			if (alpha)
+				val = fbdbi_blend_pixel(fbdbi_get_pixel(dst, cpp),
+							val, cpp,
+							fbdbi->overlay_alpha);
+			fbdbi_put_pixel(dst, cpp, val);
+		}
+	}
+}
+
+/*
+ * Write the rectangle xs,ys - xe,ye from video memory to register regnr.
+ * Full lines are contiguous in video memory and are sent directly,
+ * a narrower rectangle is first packed into the transmit buffer.
+ */
+int fbdbi_display_update(struct fbdbi_display *display, unsigned regnr,
+			 unsigned xs, unsigned xe, unsigned ys, unsigned ye)
 {
+	struct fb_info *info = display->info;
+	struct fbdbi *fbdbi = info->par;
 	struct lcdreg_transfer tr = {
 		.index = 1,
 	};
+	unsigned line_length = info->fix.line_length;
+	unsigned width = (xe - xs + 1) * info->var.bits_per_pixel / 8;
 	unsigned height = ye - ys + 1;
-	unsigned offset = ys * display->info->fix.line_length;
+	unsigned offset = ys * line_length + xs * info->var.bits_per_pixel / 8;
+	unsigned len = width * height;
+	bool lut = display->format == FBDBI_FORMAT_C8;
+	struct fbdbi_rect rect = {
+		.xs = xs,
+		.xe = xe,
+		.ys = ys,
+		.ye = ye,
+	};
+	unsigned wire_cpp = 1;
+	bool overlay;
+	u8 *src, *dst;
+	int i;
 
-	pr_debug("height=%u, offset=%u, line_length=%i\n", height, offset, display->info->fix.line_length);
+	pr_debug("xs=%u, xe=%u, height=%u, offset=%u, line_length=%i\n", xs, xe, height, offset, line_length);
 
-	tr.buf = display->info->screen_base + offset;
-	switch (display->format) {
+	switch (fbdbi_wire_format(display)) {
 	case FBDBI_FORMAT_MONO10:
 		tr.width = 8;
-		tr.count = height * display->info->fix.line_length / 8;
 		break;
 	case FBDBI_FORMAT_RGB565:
 		tr.width = 16;
-		tr.count = height * display->info->fix.line_length / 2;
+		wire_cpp = 2;
 		break;
 	case FBDBI_FORMAT_RGB888:
 		tr.width = 8;
-		tr.count = height * display->info->fix.line_length;
+		wire_cpp = 3;
 		break;
 	case FBDBI_FORMAT_XRGB8888:
 		tr.width = 24;
-		tr.count = height * display->info->fix.line_length / 4;
+		wire_cpp = 4;
 		break;
 	default:
 		return -EINVAL;
 	}
 
+	if (!fbdbi->txbuf) {
+		fbdbi->txbuf = vzalloc(fbdbi_txbuf_size(display));
+		if (!fbdbi->txbuf)
+			return -ENOMEM;
+	}
+
+	mutex_lock(&fbdbi->overlay_lock);
+	overlay = fbdbi_overlay_hit(fbdbi, &rect);
+
+	if (fbdbi_sw_rotated(display)) {
+		fbdbi_rotate_rect(display, fbdbi->txbuf, xs, xe, ys, ye);
+		if (lut)
+			fbdbi_lut_expand(fbdbi, fbdbi->txbuf, fbdbi->txbuf, len,
+					 wire_cpp);
+		tr.buf = fbdbi->txbuf;
+	} else if (fbdbi_format_is_yuv(display->format)) {
+		src = fbdbi_display_vmem(display);
+		dst = fbdbi->txbuf;
+		for (i = ys; i <= ye; i++) {
+			fbdbi_yuv_convert(info, dst, src, xs, xe, i, wire_cpp);
+			dst += (xe - xs + 1) * wire_cpp;
+		}
+		tr.buf = fbdbi->txbuf;
+		len = (xe - xs + 1) * height * wire_cpp;
+	} else if (!lut && !overlay && (width == line_length || height == 1)) {
+		tr.buf = fbdbi_display_vmem(display) + offset;
+		/*
+		 * Straight from the mapped video memory, not the snapshot,
+		 * or from the write-combined DRM framebuffer.
+		 */
+		if (fbdbi->scanout_dma) {
+			tr.dma = fbdbi->scanout_dma + offset;
+		} else if (fbdbi->vmem_dma &&
+			   tr.buf >= (void __force *)info->screen_base &&
+			   tr.buf < (void __force *)info->screen_base + info->fix.smem_len) {
+			tr.dma = fbdbi->vmem_dma +
+				 (tr.buf - (void __force *)info->screen_base);
+			dma_sync_single_for_device(info->device, tr.dma, len,
+						   DMA_TO_DEVICE);
+		}
+	} else {
+		src = fbdbi_display_vmem(display) + offset;
+		dst = fbdbi->txbuf;
+		for (i = 0; i < height; i++) {
+			if (lut)
+				fbdbi_lut_expand(fbdbi, dst, src, width, wire_cpp);
+			else
+				memcpy(dst, src, width);
+			src += line_length;
+			dst += lut ? width * wire_cpp : width;
+		}
+		tr.buf = fbdbi->txbuf;
+	}
+
+	if (overlay)
+		fbdbi_overlay_blend(fbdbi, tr.buf, wire_cpp, &rect);
+	mutex_unlock(&fbdbi->overlay_lock);
+
+	if (lut)
+		len *= wire_cpp;
+
+	/* count is in tr.width sized words, RGB888 goes out bytewise */
+	tr.count = len / (wire_cpp == 3 ? 1 : wire_cpp);
+
 	return lcdreg_write(display->lcdreg, regnr, &tr);
 }
 EXPORT_SYMBOL(fbdbi_display_update);
@@ -754,20 +3429,20 @@ int fbdbi_display_poweroff(struct fbdbi_display *display)
 EXPORT_SYMBOL(fbdbi_display_poweroff);
 
 
-//static int fbdbi_module_init(void)
-//{
-//	pr_info("%s\n", __func__);
-////debugfs stuff
-//	return 0;
-//}
-//module_init(fbdbi_module_init);
-//
-//static void fbdbi_module_exit(void)
-//{
-//	pr_info("%s\n", __func__);
-////debugfs stuff
-//}
-//module_exit(fbdbi_module_exit);
+static int fbdbi_module_init(void)
+{
+	fbdbi_debugfs_root = debugfs_create_dir("fbdbi", NULL);
+	if (!fbdbi_debugfs_root)
+		pr_warn("fbdbi: Failed to create debugfs root\n");
+	return 0;
+}
+module_init(fbdbi_module_init);
+
+static void fbdbi_module_exit(void)
+{
+	debugfs_remove_recursive(fbdbi_debugfs_root);
+}
+module_exit(fbdbi_module_exit);
 
 
 MODULE_LICENSE("GPL");
@@ -3,9 +3,16 @@
 #define __LINUX_FBDBI_H
 
 #include <linux/backlight.h>
+#include <linux/completion.h>
 #include <linux/fb.h>
+#include <linux/hrtimer.h>
+#include <linux/kthread.h>
+#include <linux/mutex.h>
 #include <linux/regulator/consumer.h>
 #include <linux/spinlock.h>
+#include <linux/timer.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 
 #include "lcdreg.h"
 
@@ -16,13 +23,75 @@ enum fbdbi_format {
 	FBDBI_FORMAT_RGB565,
 	FBDBI_FORMAT_RGB888,
 	FBDBI_FORMAT_XRGB8888,
+	FBDBI_FORMAT_C8, /* 8-bit pseudocolor, expanded to wire_format */
+	FBDBI_FORMAT_I420, /* planar YUV 4:2:0, converted to wire_format */
+	FBDBI_FORMAT_NV12, /* semi-planar YUV 4:2:0, converted to wire_format */
 };
 
 /**
+ * struct fbdbi_rect - damaged display area
+ * @xs, xe, ys, ye - first and last column/line, inclusive
+ *                   The rectangle is empty if xs > xe or ys > ye.
+ */
+struct fbdbi_rect {
+	unsigned xs;
+	unsigned xe;
+	unsigned ys;
+	unsigned ye;
+};
+
+static inline bool fbdbi_rect_empty(const struct fbdbi_rect *rect)
+{
+	return rect->xs > rect->xe || rect->ys > rect->ye;
+}
+
+#define FBDBI_DAMAGE_MAX	8
 
- * update -
- *          ys and ye are inclusive
+/*
+ * Default cost of one update() call in bytes on the bus:
+ * CASET + PASET + RAMWR, the D/C toggles and the SPI message setup.
+ */
+#define FBDBI_UPDATE_COST	256
+
+/* Shadow buffer compare and software rotation block size in pixels */
+#define FBDBI_TILE_SIZE		16
+
+/**
+ * struct fbdbi_damage - bounded list of damaged rectangles
+ * @rects - non-empty rectangles
+ * @num - number of rectangles in use
+ */
+struct fbdbi_damage {
+	struct fbdbi_rect rects[FBDBI_DAMAGE_MAX];
+	unsigned num;
+};
+
+/**
+
+ * update - write the rectangle xs,ys - xe,ye to the display
+ *          xs, xe, ys and ye are inclusive
+ * @wire_format - format sent to the controller for FBDBI_FORMAT_C8/I420/NV12,
+ *                RGB565 (default) or RGB888
+ * @buffers - number of framebuffers for page flipping, default 1
+ * @dma_vmem - physically contiguous video memory that stays DMA mapped,
+ *             frames are sent without per page mapping
+ * @lazy_vmem - allocate video memory on first open and free it together
+ *              with the transfer buffers when idle and not open
+ * @update_cost - fixed cost of one update() call in bytes on the bus.
+ *                Damage is merged when a bigger rectangle is cheaper
+ *                than an extra update() call.
  * rotate -
+ * @sw_rotate - rotate in software when filling the transfer buffer,
+ *              for controllers without usable hardware rotation.
+ *              The update callback gets panel coordinates.
+ * @set_tear - turn the tearing effect output on/off, used with te-gpios
+ * @idle - enter/exit low power idle mode, used with idle-timeout-ms
+ * @scroll - hardware vertical scroll over the first area GRAM lines, line is
+ *          the GRAM line shown at the top of the panel. Enables ywrap
+ *          panning in rotation 0.
+ * @gram_height - controller frame memory height in lines. If it holds all
+ *                buffers, each buffer is kept in its own part of GRAM and
+ *                page flips only set the scroll start.
  * @set_color_mode -
  * @blank -
  * @poweron -
@@ -38,10 +107,22 @@ struct fbdbi_display {
 	u32 xres;
 	u32 yres;
 	enum fbdbi_format format;
+	enum fbdbi_format wire_format;
 bool bgr;
+	u32 update_cost;
+	u32 buffers;
+	u32 gram_height;
+	bool dma_vmem;
+	bool lazy_vmem;
+	bool sw_rotate;
 
-	int (*update)(struct fbdbi_display *display, unsigned ys, unsigned ye);
+	int (*update)(struct fbdbi_display *display, unsigned xs, unsigned xe,
+		      unsigned ys, unsigned ye);
 	int (*rotate)(struct fbdbi_display *display);
+	int (*set_tear)(struct fbdbi_display *display, bool on);
+	int (*idle)(struct fbdbi_display *display, bool on);
+	int (*scroll)(struct fbdbi_display *display, unsigned area,
+		      unsigned line);
 	int (*set_format)(struct fbdbi_display *display);
 	int (*blank)(struct fbdbi_display *display, bool blank);
 	int (*poweron)(struct fbdbi_display *display);
@@ -56,23 +137,146 @@ void *controller_data;
 	struct regulator *power_supply;
 };
 
-//enum fbdbi_sched {
-//	FBTFT_AUTO,
-//	FBTFT_ONESHOT,
-//	FBTFT_DEFERRED,
-//	FBTFT_FIXED,
-//	FBTFT_CONTINUOUS,
-//};
+/*
+ * Update scheduling policy
+ * AUTO: same as THROTTLE
+ * ONESHOT: flush immediately, for interactive UIs
+ * DEFERRED: coalesce writes for 1/fps seconds, for the console
+ * FIXED: flush on a fixed fps grid, for video
+ * CONTINUOUS: send the full frame at fps whether it changed or not
+ * THROTTLE: flush immediately after idle, damage arriving within the
+ *           minimum frame interval is coalesced into one trailing flush
+ */
+enum fbdbi_sched {
+	FBDBI_SCHED_AUTO,
+	FBDBI_SCHED_ONESHOT,
+	FBDBI_SCHED_DEFERRED,
+	FBDBI_SCHED_FIXED,
+	FBDBI_SCHED_CONTINUOUS,
+	FBDBI_SCHED_THROTTLE,
+};
+
+#define FBDBI_DEFAULT_FPS	20
+
+/* log2 microsecond buckets, the last one also counts everything slower */
+#define FBDBI_LATENCY_BUCKETS	21
 
 struct fbdbi {
 	struct fbdbi_display *display;
 	u32 pseudo_palette[16];
+	u32 lut[256]; /* FBDBI_FORMAT_C8 palette in wire format */
 
 	spinlock_t dirty_lock;
-	unsigned dirty_lines_start;
-	unsigned dirty_lines_end;
+	struct fbdbi_damage damage;
+
+	void *txbuf;
+	dma_addr_t vmem_dma; /* 0: vmem is not DMA mapped */
+
+	/* fbdbi-drm: framebuffer being flushed, sent instead of vmem */
+	u8 *scanout;
+	dma_addr_t scanout_dma;
 
-//	enum fbdbi_sched sched;
+	/* copy of what was last sent, only changed tiles are sent */
+	u8 *shadow;
+	bool shadow_valid;
+	struct {
+		u64 frames;
+		u64 damaged;
+		u64 sent;
+		u32 last_damaged;
+		u32 last_sent;
+	} shadow_stats;
+
+	struct dentry *debugfs;
+
+	enum fbdbi_sched sched;
+	u32 fps;
+	u32 min_interval; /* us, THROTTLE, 0: use 1/fps */
+	struct hrtimer flush_timer;
+	ktime_t next_flush;
+	ktime_t deadline;
+	bool stopped;
+	bool blanked; /* damage is kept but not sent */
+	struct {
+		u64 flushes;
+		u64 missed;
+		s64 last_late;
+		s64 max_late;
+	} pacing_stats;
+
+	/* damage-to-glass latency: first damage of a cycle to update() done */
+	u64 damage_ns; /* 0: no damage since the last flush started */
+	u64 cycle_ns; /* damage_ns of the flush in progress */
+	struct {
+		u64 hist[FBDBI_LATENCY_BUCKETS];
+		u64 count;
+		u64 sum; /* us */
+		u64 max; /* us */
+		u64 window_start; /* ns */
+		u32 window_frames;
+		u32 fps_x10; /* frames sent per second, last 1s+ window */
+	} latency_stats;
+
+	/* tearing effect signal, flushes start on the TE pulse */
+	struct gpio_desc *te;
+	struct completion te_complete;
+	ktime_t te_last;
+	u64 te_period;
+	u64 te_count;
+	u64 te_timeouts;
+	u64 write_rate; /* bytes per second on the bus, measured */
+
+	/* page flipping: pan_yoffset is latched into yoffset at flush start */
+	u32 pan_yoffset;
+	u32 yoffset;
+	bool flushing;
+	u64 flush_seq; /* last completed flush */
+	ktime_t flush_time;
+	wait_queue_head_t flush_wait;
+
+	/*
+	 * Snapshot of the damaged area taken at flush start, the transfer
+	 * reads from the snapshot while clients keep drawing.
+	 */
+	u8 *snapshot;
+	u32 snapshot_size;
+	bool snapshot_valid;
+
+	/* flushes run on a per display worker thread */
+	struct kthread_worker worker;
+	struct task_struct *worker_task;
+	struct kthread_work flush_work;
+	u32 rt_priority;
+	int cpu;
+
+	/* fb_defio's mmap, used when page fault tracking is on */
+	int (*defio_mmap)(struct fb_info *info, struct vm_area_struct *vma);
+	bool untracked_mmap;
+
+	/* hardware scroll (ywrap panning or GRAM page flipping) */
+	bool ywrap;
+	bool gram_flip;
+	u32 scroll_line;
+	bool scroll_pending;
+
+	/* idle governor */
+	u32 idle_timeout; /* ms, 0: off */
+	bool idle;
+	struct timer_list idle_timer;
+	struct kthread_work idle_work;
+
+	/* lazy video memory, allocated while the fb is open */
+	struct mutex vmem_lock;
+	unsigned open_count;
+	struct kthread_work release_work;
+
+	/* overlay plane, composited in fbdbi_display_update() */
+	struct mutex overlay_lock;
+	u8 *overlay; /* NULL: disabled */
+	struct fbdbi_rect overlay_rect;
+	u32 overlay_flags;
+	u32 overlay_colorkey;
+	u32 overlay_alpha;
 };
 
 
@@ -83,16 +287,40 @@ extern int devm_register_framebuffer(struct fb_info *info);
 
 extern u32 fbdbi_of_value(struct device *dev, const char *propname, u32 def_value);
 extern u32 fbdbi_of_format(struct device *dev, enum fbdbi_format def_format);
+extern enum fbdbi_sched fbdbi_of_sched(struct device *dev, enum fbdbi_sched def_sched);
 
 extern int devm_fbdbi_init(struct device *dev, struct fbdbi_display *display);
 extern int devm_fbdbi_register(struct fbdbi_display *display);
 extern int devm_fbdbi_register_dt(struct device *dev, struct fbdbi_display *display);
+extern int devm_fbdbi_drm_register_dt(struct device *dev, struct fbdbi_display *display);
+extern void fbdbi_damage_from_rects(struct fb_info *info,
+				    struct fbdbi_damage *damage,
+				    const struct fbdbi_rect *rects,
+				    unsigned num);
 
-extern int fbdbi_display_update(struct fbdbi_display *display, unsigned regnr, unsigned ys, unsigned ye);
+extern u8 *fbdbi_display_vmem(struct fbdbi_display *display);
+extern int fbdbi_display_update(struct fbdbi_display *display, unsigned regnr,
+				unsigned xs, unsigned xe, unsigned ys, unsigned ye);
 extern int fbdbi_display_poweroff(struct fbdbi_display *display);
 
 
 
+static inline bool fbdbi_format_is_yuv(enum fbdbi_format format)
+{
+	return format == FBDBI_FORMAT_I420 || format == FBDBI_FORMAT_NV12;
+}
+
+/* The pixel format on the bus */
+static inline
+enum fbdbi_format fbdbi_wire_format(const struct fbdbi_display *display)
+{
+	if (display->format == FBDBI_FORMAT_C8 ||
+	    fbdbi_format_is_yuv(display->format))
+		return display->wire_format ? : FBDBI_FORMAT_RGB565;
+
+	return display->format;
+}
+
 static inline
 void fbdbi_merge_display(struct fbdbi_display *display, const struct fbdbi_display *controller, struct lcdreg *lcdreg)
 {
@@ -106,6 +334,15 @@ void fbdbi_merge_display(struct fbdbi_display *display, const struct fbdbi_displ
 		display->update = controller->update;
 	if (!display->rotate)
 		display->rotate = controller->rotate;
+	if (!display->set_tear)
+		display->set_tear = controller->set_tear;
+	if (!display->idle)
+		display->idle = controller->idle;
+	if (!display->scroll)
+		display->scroll = controller->scroll;
+	if (!display->gram_height)
+		display->gram_height = controller->gram_height;
+	display->sw_rotate |= controller->sw_rotate;
 	display->lcdreg = lcdreg;
 }
 
@@ -209,6 +209,15 @@ int devm_lcdreg_i80_parse_dt(struct device *dev, struct lcdreg_i80_config *confi
 }
 EXPORT_SYMBOL(devm_lcdreg_i80_parse_dt);
 
+static void lcdreg_i80_release_buffers(struct lcdreg *reg)
+{
+	struct lcdreg_i80 *i80lcd = to_lcdreg_i80(reg);
+
+	if (i80lcd->buffer)
+		devm_kfree(&i80lcd->i80->dev, i80lcd->buffer);
+	i80lcd->buffer = NULL;
+}
+
 struct lcdreg *devm_lcdreg_i80_init(struct i80_device *i80,
 				    const struct lcdreg_i80_config *config)
 {
@@ -236,6 +245,7 @@ struct lcdreg *devm_lcdreg_i80_init(struct i80_device *i80,
 	i80lcd->reg.write = lcdreg_i80_write;
 	i80lcd->reg.read = lcdreg_i80_read;
 	i80lcd->reg.reset = lcdreg_i80_reset;
+	i80lcd->reg.release_buffers = lcdreg_i80_release_buffers;
 
 	return devm_lcdreg_init(&i80->dev, &i80lcd->reg);
 }
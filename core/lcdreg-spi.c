@@ -110,8 +110,9 @@ lcdreg_spi_transfer(struct lcdreg *reg, struct lcdreg_transfer *transfer)
 	struct page *vm_page;
 	bool do_dma = false;
 	void *buf = transfer->buf;
+	dma_addr_t dma_buf = transfer->dma;
 /*	const int desc_len = vmalloced_buf ? PAGE_SIZE : master->max_dma_len; */
-	const int desc_len = PAGE_SIZE;
+	int desc_len = PAGE_SIZE;
 
 	size_t len = transfer->count * lcdreg_bytes_per_word(transfer->width);
 	size_t min;
@@ -129,6 +130,12 @@ lcdreg_spi_transfer(struct lcdreg *reg, struct lcdreg_transfer *transfer)
 	if (transfer->index == 1 && len > 128 && dma)
 		do_dma = true;
 
+	/* premapped buffer: one transfer, no mapping in this path */
+	if (do_dma && dma_buf) {
+		desc_len = len;
+		trs = 2;
+	}
+
 	tr = kzalloc(trs * sizeof(*tr), GFP_KERNEL);
 	if (!tr)
 		return -ENOMEM;
@@ -178,11 +185,13 @@ lcdreg_spi_transfer(struct lcdreg *reg, struct lcdreg_transfer *transfer)
 			 * transfer->buf might not be on a PAGE boundary
 			 * align to PAGE by doing a small transfer
 			 */
-			if (vmalloced_buf && (buf == transfer->buf)) {
+			if (vmalloced_buf && !dma_buf && (buf == transfer->buf)) {
 				min = min_t(size_t, min, PAGE_SIZE - offset_in_page(buf));
 			}
 
-			if (vmalloced_buf) {
+			if (do_dma && dma_buf) {
+				tr[i].tx_buf = buf;
+			} else if (vmalloced_buf) {
 				vm_page = vmalloc_to_page(buf);
 				if (!vm_page) {
 					dev_dbg(&sdev->dev,
@@ -202,7 +211,10 @@ lcdreg_spi_transfer(struct lcdreg *reg, struct lcdreg_transfer *transfer)
 
 			tr[i].len = min;
 			tr[i].bits_per_word = transfer->width;
-			if (do_dma) {
+			if (do_dma && dma_buf) {
+				tr[i].tx_dma = dma_buf;
+				dma_buf += min;
+			} else if (do_dma) {
 				tr[i].tx_dma = dma_map_single(&sdev->dev, (void *) tr[i].tx_buf,
 									tr[i].len, DMA_TO_DEVICE);
 				if (dma_mapping_error(&sdev->dev, tr[i].tx_dma)) {
@@ -218,7 +230,7 @@ lcdreg_spi_transfer(struct lcdreg *reg, struct lcdreg_transfer *transfer)
 		}
 		lcdreg_vdbg_dump_spi(&sdev->dev, &m, spi->startbuf);
 		ret = spi_sync(sdev, &m);
-		if (do_dma) {
+		if (do_dma && !transfer->dma) {
 			list_for_each(pos, &m.transfers) {
 				tmp = list_entry(pos, struct spi_transfer, transfer_list);
 				dma_unmap_single(&sdev->dev, tmp->tx_dma, tmp->len, DMA_TO_DEVICE);
@@ -236,6 +248,18 @@ transfer_out:
 }
 
 
+static void lcdreg_spi_release_buffers(struct lcdreg *reg)
+{
+	struct lcdreg_spi *spi = to_lcdreg_spi(reg);
+
+	if (spi->txbuf)
+		devm_kfree(reg->dev, spi->txbuf);
+	spi->txbuf = NULL;
+	if (spi->txbuf_dc)
+		devm_kfree(reg->dev, spi->txbuf_dc);
+	spi->txbuf_dc = NULL;
+}
+
 static int lcdreg_spi_write_one(struct lcdreg *reg, struct lcdreg_transfer *transfer)
 {
 	struct lcdreg_spi *spi = to_lcdreg_spi(reg);
@@ -787,6 +811,7 @@ spi->startbyte = config->startbyte;
 	else
 		spi->reg.read = lcdreg_spi_read;
 	spi->reg.reset = lcdreg_spi_reset;
+	spi->reg.release_buffers = lcdreg_spi_release_buffers;
 
 pr_debug("spi->reg.def_width: %u\n", spi->reg.def_width);
 if (spi->reset)
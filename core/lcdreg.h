@@ -35,6 +35,8 @@
  * @buf - data array to transfer
  * @count - number of items in array
  * @width - override default regwidth
+ * @dma - DMA address of buf if it is already mapped, 0 otherwise.
+ *        The caller syncs the buffer for the device.
  * @slow - slow down write transfers (reading is always slow)
  */
 struct lcdreg_transfer {
@@ -42,6 +44,7 @@ struct lcdreg_transfer {
 	void *buf;
 	unsigned count;
 	unsigned width;
+	dma_addr_t dma;
 };
 
 /**
@@ -64,6 +67,8 @@ struct lcdreg {
 	int (*write)(struct lcdreg *reg, unsigned regnr, struct lcdreg_transfer *transfer);
 	int (*read)(struct lcdreg *reg, unsigned regnr, struct lcdreg_transfer *transfer);
 	void (*reset)(struct lcdreg *reg);
+	/* free bounce buffers, they are reallocated on the next transfer */
+	void (*release_buffers)(struct lcdreg *reg);
 
 	u64 quirks;
 /* slow down command (index=0) */
@@ -188,6 +193,13 @@ static inline void lcdreg_unlock(struct lcdreg *reg)
 	mutex_unlock(&reg->lock);
 }
 
+/* caller must hold the lock */
+static inline void lcdreg_release_buffers(struct lcdreg *reg)
+{
+	if (reg->release_buffers)
+		reg->release_buffers(reg);
+}
+
 static inline bool lcdreg_is_readable(struct lcdreg *reg)
 {
 	return reg->readable;
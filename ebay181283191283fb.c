@@ -176,15 +176,10 @@ static int ebay181283191283_probe_common(struct lcdreg *lcdreg)
 	display->yres = 480;
 	display->format = fbdbi_of_format(dev, FBDBI_FORMAT_RGB565);
 	display->poweron = ebay181283191283_poweron;
+	/* a backlight phandle in DT replaces the controller PWM */
+	display->backlight = ssd1963_backlight_register(lcdreg, NULL, 255);
 
-	ret = devm_fbdbi_init(dev, display);
-	if (ret)
-		return ret;
-
-	display->info->var.rotate = fbdbi_of_value(dev, "rotate", 0);
-	display->backlight = ssd1963_backlight_register(lcdreg, display->info, 255);
-
-	return devm_fbdbi_register(display);
+	return devm_fbdbi_register_dt(dev, display);
 }
 
 static int ebay181283191283_i80_probe(struct i80_device *i80dev)
@@ -116,6 +116,7 @@ static int fbdbi_driver_probe_spi(struct spi_device *spi)
 		.addr_mode90 = 0x18,
 		.addr_mode180 = 0x00,
 		.addr_mode270 = 0x28,
+		.base_image = 0x0001,
 		.bgr = true,
 	};
 
@@ -11,6 +11,7 @@ struct ili9320_controller {
 	unsigned addr_mode90;
 	unsigned addr_mode180;
 	unsigned addr_mode270;
+	unsigned base_image;
 	struct fbdbi_display display;
 };
 
@@ -23,38 +24,66 @@ static inline struct ili9320_controller *to_controller(struct fbdbi_display *dis
 #define WIDTH		240
 #define HEIGHT		320
 
-static int ili9320_update(struct fbdbi_display *display, unsigned ys, unsigned ye)
+/*
+ * The GRAM window (0x50-0x53) and start address (0x20/0x21) are in
+ * unrotated GRAM coordinates. Entry mode (set in rotate) makes the
+ * address counter walk the window in the rotated direction.
+ */
+static int ili9320_update(struct fbdbi_display *display, unsigned xs,
+			  unsigned xe, unsigned ys, unsigned ye)
 {
 	struct lcdreg *lcdreg = display->lcdreg;
 	u16 horizontal, vertical;
+	u16 hsa, hea, vsa, vea;
 	int ret;
 
-	pr_debug("%s(ys=%u, ye=%u): xres=%u, yres=%u\n", __func__, ys, ye, display->info->var.xres, display->info->var.yres);
+	pr_debug("%s(xs=%u, xe=%u, ys=%u, ye=%u): xres=%u, yres=%u\n", __func__, xs, xe, ys, ye, display->info->var.xres, display->info->var.yres);
 
 	switch (display->info->var.rotate) {
 	case 0:
 	default:
-		horizontal = 0;
+		horizontal = xs;
 		vertical = ys;
+		hsa = xs;
+		hea = xe;
+		vsa = ys;
+		vea = ye;
 		break;
 	case 180:
-		horizontal = WIDTH - 1 - 0;
+		horizontal = WIDTH - 1 - xs;
 		vertical = HEIGHT - 1 - ys;
+		hsa = WIDTH - 1 - xe;
+		hea = WIDTH - 1 - xs;
+		vsa = HEIGHT - 1 - ye;
+		vea = HEIGHT - 1 - ys;
 		break;
 	case 270:
 		horizontal = WIDTH - 1 - ys;
-		vertical = 0;
+		vertical = xs;
+		hsa = WIDTH - 1 - ye;
+		hea = WIDTH - 1 - ys;
+		vsa = xs;
+		vea = xe;
 		break;
 	case 90:
 		horizontal = ys;
-		vertical = HEIGHT - 1 - 0;
+		vertical = HEIGHT - 1 - xs;
+		hsa = ys;
+		hea = ye;
+		vsa = HEIGHT - 1 - xe;
+		vea = HEIGHT - 1 - xs;
 		break;
 	}
 
 	lcdreg_lock(display->lcdreg);
-	ret = lcdreg_writereg(lcdreg, ILI9320_HORIZONTAL_GRAM_ADDRESS_SET, horizontal);
+	ret = lcdreg_writereg(lcdreg, ILI9320_HORIZONTAL_ADDRESS_START_POSITION, hsa);
+	ret |= lcdreg_writereg(lcdreg, ILI9320_HORIZONTAL_ADDRESS_END_POSITION, hea);
+	ret |= lcdreg_writereg(lcdreg, ILI9320_VERTICAL_ADDRESS_START_POSITION, vsa);
+	ret |= lcdreg_writereg(lcdreg, ILI9320_VERTICAL_ADDRESS_END_POSITION, vea);
+	ret |= lcdreg_writereg(lcdreg, ILI9320_HORIZONTAL_GRAM_ADDRESS_SET, horizontal);
 	ret |= lcdreg_writereg(lcdreg, ILI9320_VERTICAL_GRAM_ADDRESS_SET, vertical);
-	ret |= fbdbi_display_update(display, ILI9320_WRITE_DATA_TO_GRAM, ys, ye);
+	ret |= fbdbi_display_update(display, ILI9320_WRITE_DATA_TO_GRAM,
+				    xs, xe, ys, ye);
 	lcdreg_unlock(display->lcdreg);
 
 	return ret;
@@ -87,11 +116,32 @@ static int ili9320_rotate(struct fbdbi_display *display)
 	return lcdreg_writereg(lcdreg, ILI9320_ENTRY_MODE, val);
 }
 
+#define ILI9320_VLE	BIT(1)
+
+/* The scroll area is always the whole panel */
+static int ili9320_scroll(struct fbdbi_display *display, unsigned area,
+			  unsigned line)
+{
+	struct lcdreg *lcdreg = display->lcdreg;
+	struct ili9320_controller *controller = to_controller(display);
+	int ret;
+
+	pr_debug("%s(line=%u)\n", __func__, line);
+
+	ret = lcdreg_writereg(lcdreg, ILI9320_VERTICAL_SCROLL_CONTROL, line);
+	ret |= lcdreg_writereg(lcdreg, ILI9320_BASE_IMAGE_DISPLAY_CONTROL,
+			       controller->base_image |
+			       (line ? ILI9320_VLE : 0));
+
+	return ret;
+}
+
 static const struct fbdbi_display ili9320_display = {
 	.xres = 240,
 	.yres = 320,
 	.update = ili9320_update,
 	.rotate = ili9320_rotate,
+	.scroll = ili9320_scroll,
 	.poweroff = fbdbi_display_poweroff,
 };
 
@@ -120,6 +170,7 @@ struct fbdbi_display *devm_ili9320_init(struct lcdreg *lcdreg,
 	controller->addr_mode90 = config->addr_mode90 | (config->bgr << 12);
 	controller->addr_mode180 = config->addr_mode180 | (config->bgr << 12);
 	controller->addr_mode270 = config->addr_mode270 | (config->bgr << 12);
+	controller->base_image = config->base_image;
 
 	return display;
 }
@@ -65,6 +65,7 @@ struct ili9320_config {
 	unsigned addr_mode90;
 	unsigned addr_mode180;
 	unsigned addr_mode270;
+	unsigned base_image; /* NDL and REV bits of register 0x61 */
 	bool bgr;
 };
 
@@ -176,6 +176,7 @@ static int itdb02_28_probe_common(struct lcdreg *lcdreg)
 		.addr_mode90 = 0x18,
 		.addr_mode180 = 0x00,
 		.addr_mode270 = 0x28,
+		.base_image = 0x0001,
 		.bgr = true,
 	};
 
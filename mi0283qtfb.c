@@ -34,11 +34,52 @@ Optional properties:
 			- IM=01xx: SPI master driver supports spi-3wire (SDA)
 - rotate		Display rotation in degrees counter clockwise
 - backlight		phandle of the backlight device attached to the panel
+- te-gpios		Tearing effect pin. Updates are started on the TE pulse.
 
 - format:		Framebuffer format:
 			- "rgb565" (default)
 			- "rgb888" RGB666 on display
 			- "xrgb8888" RGB666 on display
+			- "c8" 8-bit pseudocolor, see wire-format
+			- "i420" planar YUV 4:2:0, see wire-format
+			- "nv12" semi-planar YUV 4:2:0, see wire-format
+- wire-format		Format sent to the display for c8, i420 and nv12:
+			- "rgb565" (default)
+			- "rgb888" RGB666 on display
+- drm			Register a DRM device instead of a framebuffer
+			(needs fbdbi-drm, rgb565/rgb888/xrgb8888 only)
+- gram-height		Controller frame memory height in lines, at least
+			the panel height. When it holds all buffers, each
+			buffer stays in its own part of frame memory and a
+			pan only sets the scroll start (rotate 0 only).
+- buffers		Number of framebuffers for page flipping, 1-3
+			(default 1)
+- sw-rotate		Rotate in software instead of in the controller
+- update-cost		Bus bytes one update() call costs on top of the
+			pixels, used to decide when to merge rectangles
+- shadow-buffer		Keep a copy of what the panel shows and only send
+			rows that changed
+- snapshot		Copy the damage at flush start, so clients can keep
+			drawing during the transfer
+- dma-vmem		Allocate video memory DMA mapped for the device
+			lifetime, sent in one transfer
+- lazy-alloc		Allocate video memory and transfer buffers on first
+			open, free them again after the last close
+- sched			Flush scheduling:
+			- "auto" (default) flush at once, then at most fps
+			- "oneshot" flush at once on damage
+			- "deferred" flush one period after the first damage
+			- "fixed" flush on a fixed fps grid
+			- "continuous" refresh the whole panel at fps
+			- "throttle" like auto, spaced by min-interval-us
+- fps			Flush rate for the sched modes (default 20)
+- min-interval-us	Minimum time between flushes for auto and throttle,
+			instead of 1/fps
+- rt-priority		SCHED_FIFO priority of the flush thread, 0 (default)
+			keeps it SCHED_NORMAL
+- cpu			CPU to run the flush thread on (default any)
+- idle-timeout-ms	Enter controller idle mode after this long without
+			damage, 0 (default) disables it
 
 
 Examples:
@@ -190,6 +231,7 @@ static int mi0283qt_probe(struct spi_device *spi)
 	struct mipi_dbi_config mipicfg = {
 		.xres = 240,
 		.yres = 320,
+		.gram_height = 320,
 		.addr_mode0 = ILI9341_MADCTL_MX,
 		.addr_mode90 = ILI9341_MADCTL_MV | ILI9341_MADCTL_MY |
 			       ILI9341_MADCTL_MX,
@@ -24,6 +24,7 @@ struct mipi_dbi_controller {
 	unsigned addr_mode90;
 	unsigned addr_mode180;
 	unsigned addr_mode270;
+	bool bgr;
 	struct fbdbi_display display;
 };
 
@@ -32,21 +33,21 @@ static inline struct mipi_dbi_controller *to_controller(struct fbdbi_display *di
 	return display ? container_of(display, struct mipi_dbi_controller, display) : NULL;
 }
 
-static int mipi_dbi_update(struct fbdbi_display *display, unsigned ys, unsigned ye)
+static int mipi_dbi_update(struct fbdbi_display *display, unsigned xs,
+			   unsigned xe, unsigned ys, unsigned ye)
 {
 	struct lcdreg *lcdreg = display->lcdreg;
-	u16 xs = 0;
-	u16 xe = display->info->var.xres - 1;
 	int ret;
 
-	pr_debug("%s(ys=%u, ye=%u): xres=%u, yres=%u\n", __func__, ys, ye, display->info->var.xres, display->info->var.yres);
+	pr_debug("%s(xs=%u, xe=%u, ys=%u, ye=%u): xres=%u, yres=%u\n", __func__, xs, xe, ys, ye, display->info->var.xres, display->info->var.yres);
 
 	lcdreg_lock(display->lcdreg);
 	ret = lcdreg_writereg(lcdreg, MIPI_DCS_SET_COLUMN_ADDRESS,
 		    (xs >> 8) & 0xFF, xs & 0xFF, (xe >> 8) & 0xFF, xe & 0xFF);
 	ret |= lcdreg_writereg(lcdreg, MIPI_DCS_SET_PAGE_ADDRESS,
 		    (ys >> 8) & 0xFF, ys & 0xFF, (ye >> 8) & 0xFF, ye & 0xFF);
-	ret |= fbdbi_display_update(display, MIPI_DCS_WRITE_MEMORY_START, ys, ye);
+	ret |= fbdbi_display_update(display, MIPI_DCS_WRITE_MEMORY_START,
+				    xs, xe, ys, ye);
 	lcdreg_unlock(display->lcdreg);
 
 	return ret;
@@ -56,10 +57,17 @@ static int mipi_dbi_rotate(struct fbdbi_display *display)
 {
 	struct lcdreg *lcdreg = display->lcdreg;
 	struct mipi_dbi_controller *controller = to_controller(display);
+	bool bgr = controller->bgr;
 	u8 val;
 
 	pr_debug("%s(): rotate=%u\n", __func__, display->info->var.rotate);
 
+	/* the wire format is known by now, c8 and YUV get it from DT */
+#ifdef __LITTLE_ENDIAN
+	if (fbdbi_wire_format(display) == FBDBI_FORMAT_RGB888)
+		bgr = !bgr;
+#endif
+
 	switch (display->info->var.rotate) {
 	case 0:
 	default:
@@ -76,7 +84,48 @@ static int mipi_dbi_rotate(struct fbdbi_display *display)
 		break;
 	}
 
-	return lcdreg_writereg(lcdreg, MIPI_DCS_SET_ADDRESS_MODE, val);
+	return lcdreg_writereg(lcdreg, MIPI_DCS_SET_ADDRESS_MODE,
+			       val | (bgr << 3));
+}
+
+static int mipi_dbi_set_tear(struct fbdbi_display *display, bool on)
+{
+	struct lcdreg *lcdreg = display->lcdreg;
+
+	pr_debug("%s(on=%u)\n", __func__, on);
+
+	/* V-blank only */
+	if (on)
+		return lcdreg_writereg(lcdreg, MIPI_DCS_SET_TEAR_ON, 0x00);
+
+	return lcdreg_writereg(lcdreg, MIPI_DCS_SET_TEAR_OFF);
+}
+
+static int mipi_dbi_idle(struct fbdbi_display *display, bool on)
+{
+	pr_debug("%s(on=%u)\n", __func__, on);
+
+	return lcdreg_writereg(display->lcdreg, on ? MIPI_DCS_ENTER_IDLE_MODE :
+						     MIPI_DCS_EXIT_IDLE_MODE);
+}
+
+/* The lines below the scroll area are the bottom fixed area */
+static int mipi_dbi_scroll(struct fbdbi_display *display, unsigned area,
+			   unsigned line)
+{
+	struct lcdreg *lcdreg = display->lcdreg;
+	unsigned bfa = display->gram_height - area;
+	int ret;
+
+	pr_debug("%s(area=%u, line=%u)\n", __func__, area, line);
+
+	ret = lcdreg_writereg(lcdreg, MIPI_DCS_SET_SCROLL_AREA, 0x00, 0x00,
+			      (area >> 8) & 0xFF, area & 0xFF,
+			      (bfa >> 8) & 0xFF, bfa & 0xFF);
+	ret |= lcdreg_writereg(lcdreg, MIPI_DCS_SET_SCROLL_START,
+			       (line >> 8) & 0xFF, line & 0xFF);
+
+	return ret;
 }
 
 static int mipi_dbi_set_format(struct fbdbi_display *display)
@@ -86,7 +135,7 @@ static int mipi_dbi_set_format(struct fbdbi_display *display)
 
 	pr_debug("%s(): format=%i, bits_per_pixel=%u\n", __func__, display->format, display->info->var.bits_per_pixel);
 
-	switch (display->format) {
+	switch (fbdbi_wire_format(display)) {
 	case FBDBI_FORMAT_RGB565:
 		val = 0x05;
 		break;
@@ -106,6 +155,9 @@ static const struct fbdbi_display mipi_dbi_display = {
 	.yres = 0,
 	.update = mipi_dbi_update,
 	.rotate = mipi_dbi_rotate,
+	.set_tear = mipi_dbi_set_tear,
+	.idle = mipi_dbi_idle,
+	.scroll = mipi_dbi_scroll,
 	.set_format = mipi_dbi_set_format,
 	.poweroff = fbdbi_display_poweroff,
 };
@@ -115,7 +167,6 @@ struct fbdbi_display *devm_mipi_dbi_init(struct lcdreg *lcdreg,
 {
 	struct mipi_dbi_controller *controller;
 	struct fbdbi_display *display;
-	bool bgr = config->bgr;
 
 	pr_debug("%s()\n", __func__);
 
@@ -129,15 +180,16 @@ struct fbdbi_display *devm_mipi_dbi_init(struct lcdreg *lcdreg,
 	display->lcdreg->def_width = config->regwidth ? : 8;
 	display->xres = config->xres;
 	display->yres = config->yres;
+	display->gram_height = config->gram_height;
+	/* the scroll area can't be set up without knowing the GRAM height */
+	if (display->gram_height < display->yres)
+		display->scroll = NULL;
 	display->format = config->format ? : FBDBI_FORMAT_RGB565;
-#ifdef __LITTLE_ENDIAN
-	if (display->format == FBDBI_FORMAT_RGB888)
-		bgr = !bgr;
-#endif
-	controller->addr_mode0 = config->addr_mode0 | (bgr << 3);
-	controller->addr_mode90 = config->addr_mode90 | (bgr << 3);
-	controller->addr_mode180 = config->addr_mode180 | (bgr << 3);
-	controller->addr_mode270 = config->addr_mode270 | (bgr << 3);
+	controller->addr_mode0 = config->addr_mode0;
+	controller->addr_mode90 = config->addr_mode90;
+	controller->addr_mode180 = config->addr_mode180;
+	controller->addr_mode270 = config->addr_mode270;
+	controller->bgr = config->bgr;
 
 	return display;
 }
@@ -20,6 +20,7 @@ struct mipi_dbi_config {
 	unsigned regwidth;
 	u32 xres;
 	u32 yres;
+	u32 gram_height;
 	enum fbdbi_format format;
 	unsigned addr_mode0;
 	unsigned addr_mode90;
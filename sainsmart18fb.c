@@ -128,6 +128,8 @@ static int fbdbi_driver_probe_spi(struct spi_device *spi)
 	struct mipi_dbi_config mipicfg = {
 		.xres = 128,
 		.yres = 160,
+		/* 132x162 frame memory */
+		.gram_height = 162,
 		.addr_mode0 = ST7735_MADCTL_MX | ST7735_MADCTL_MY,
 		.addr_mode90 = ST7735_MADCTL_MX | ST7735_MADCTL_MV,
 		.addr_mode180 = 0,
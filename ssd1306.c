@@ -24,6 +24,7 @@
 struct ssd1306_controller {
 	struct fbdbi_display display;
 	void *buf;
+	unsigned start_line;
 };
 
 static inline struct ssd1306_controller *to_controller(struct fbdbi_display *display)
@@ -31,21 +32,32 @@ static inline struct ssd1306_controller *to_controller(struct fbdbi_display *dis
 	return display ? container_of(display, struct ssd1306_controller, display) : NULL;
 }
 
-static int ssd1306_update(struct fbdbi_display *display, unsigned ys, unsigned ye)
+/* The controller is always written in full, the rectangle is ignored */
+static int ssd1306_update(struct fbdbi_display *display, unsigned xs,
+			  unsigned xe, unsigned ys, unsigned ye)
 {
 	struct lcdreg *lcdreg = display->lcdreg;
+	struct ssd1306_controller *controller = to_controller(display);
 	struct fb_var_screeninfo *var = &display->info->var;
-	u8 *buf = to_controller(display)->buf;
+	u8 *buf;
 	int x, y, i;
 	int ret;
 	struct lcdreg_transfer tr = {
 		.index = 1,
 		.width = 8,
-		.buf = buf,
 		.count = var->xres * var->yres / 8,
 	};
 
-	pr_debug("%s(ys=%u, ye=%u): xres=%u, yres=%u\n", __func__, ys, ye, var->xres, var->yres);
+	pr_debug("%s(xs=%u, xe=%u, ys=%u, ye=%u): xres=%u, yres=%u\n", __func__, xs, xe, ys, ye, var->xres, var->yres);
+
+	/* allocated on first use, headless setups never pay for it */
+	if (!controller->buf) {
+		controller->buf = devm_kzalloc(lcdreg->dev, tr.count, GFP_KERNEL);
+		if (!controller->buf)
+			return -ENOMEM;
+	}
+	buf = controller->buf;
+	tr.buf = buf;
 
 	lcdreg_lock(lcdreg);
 
@@ -58,7 +70,7 @@ static int ssd1306_update(struct fbdbi_display *display, unsigned ys, unsigned y
 	 *    monochrome framebuffers.
 	 */
 	if (display->format == FBDBI_FORMAT_RGB565) {
-		u16 *vmem16 = (u16 *)display->info->screen_base;
+		u16 *vmem16 = (u16 *)fbdbi_display_vmem(display);
 
 		/* TODO: add better conversion as done in fb_agm1264k-fl */
 		for (x = 0; x < var->xres; x++) {
@@ -70,7 +82,7 @@ static int ssd1306_update(struct fbdbi_display *display, unsigned ys, unsigned y
 			}
 		}
 	} else { /* FBDBI_FORMAT_MONO10 */
-		u8 *vmem8 = (u8 *)display->info->screen_base;
+		u8 *vmem8 = fbdbi_display_vmem(display);
 
 		for (x = 0; x < var->xres; x++) {
 			for (y = 0; y < var->yres / 8; y++) {
@@ -86,12 +98,26 @@ static int ssd1306_update(struct fbdbi_display *display, unsigned ys, unsigned y
 		}
 	}
 
-	ret = lcdreg_write(lcdreg, SSD1306_DISPLAY_START_LINE, &tr);
+	/* the command byte before the data also sets the start line */
+	ret = lcdreg_write(lcdreg, SSD1306_DISPLAY_START_LINE |
+			   controller->start_line, &tr);
 	lcdreg_unlock(lcdreg);
 
 	return ret;
 }
 
+/* The scroll area is always the whole GRAM, the start line wraps at 64 */
+static int ssd1306_scroll(struct fbdbi_display *display, unsigned area,
+			  unsigned line)
+{
+	pr_debug("%s(line=%u)\n", __func__, line);
+
+	to_controller(display)->start_line = line;
+
+	return lcdreg_writereg(display->lcdreg,
+			       SSD1306_DISPLAY_START_LINE | line);
+}
+
 static int ssd1306_blank(struct fbdbi_display *display, bool blank)
 {
 	pr_debug("%s(blank=%i)\n", __func__, blank);
@@ -126,6 +152,7 @@ static int ssd1306_poweroff(struct fbdbi_display *display)
 static const struct fbdbi_display ssd1306_display = {
 	.update = ssd1306_update,
 	.blank = ssd1306_blank,
+	.scroll = ssd1306_scroll,
 	.set_format = ssd1306_set_format,
 	.poweroff = ssd1306_poweroff,
 };
@@ -150,12 +177,11 @@ struct fbdbi_display *devm_ssd1306_init(struct lcdreg *lcdreg,
 	display->xres = config->xres ? : 128;
 	display->yres = config->yres ? : 64;
 	display->format = FBDBI_FORMAT_MONO10;
-
-	controller->buf = devm_kzalloc(lcdreg->dev,
-				       display->xres * display->yres / 8,
-				       GFP_KERNEL);
-	if (!controller->buf)
-		return ERR_PTR(-ENOMEM);
+	/* scrolling wraps at 64 GRAM lines, a shorter panel would show the rest */
+	if (display->yres != 64)
+		display->scroll = NULL;
+	/* every update() sends the whole frame */
+	display->update_cost = display->xres * display->yres / 8;
 
 	return display;
 }
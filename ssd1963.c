@@ -20,44 +20,62 @@
 #include "core/fbdbi.h"
 
 
-static int ssd1963_update(struct fbdbi_display *display, unsigned ys, unsigned ye)
+static int ssd1963_update(struct fbdbi_display *display, unsigned xs,
+			  unsigned xe, unsigned ys, unsigned ye)
 {
 	struct lcdreg *par = display->lcdreg;
-	u16 xs = 0;
-	u16 xe = display->info->var.xres - 1;
 	int ret;
 
-	pr_debug("%s(ys=%u, ye=%u): xres=%u, yres=%u\n", __func__, ys, ye, display->info->var.xres, display->info->var.yres);
+	pr_debug("%s(xs=%u, xe=%u, ys=%u, ye=%u): xres=%u, yres=%u\n", __func__, xs, xe, ys, ye, display->info->var.xres, display->info->var.yres);
 
 	lcdreg_lock(display->lcdreg);
 	ret = lcdreg_writereg(par, SSD1963_SET_COLUMN_ADDRESS,
 		(xs >> 8) & 0xFF, xs & 0xFF, (xe >> 8) & 0xFF, xe & 0xFF);
 	ret |= lcdreg_writereg(par, SSD1963_SET_PAGE_ADDRESS,
 		(ys >> 8) & 0xFF, ys & 0xFF, (ye >> 8) & 0xFF, ye & 0xFF);
-	ret |= fbdbi_display_update(display, SSD1963_WRITE_MEMORY_START, ys, ye);
+	ret |= fbdbi_display_update(display, SSD1963_WRITE_MEMORY_START,
+				    xs, xe, ys, ye);
 	lcdreg_unlock(display->lcdreg);
 
 	return ret;
 }
 
-static int ssd1963_rotate(struct fbdbi_display *display)
+static int ssd1963_set_tear(struct fbdbi_display *display, bool on)
 {
-//	struct lcdreg *par = display->lcdreg;
-//
-	pr_info("%s(): rotate=%u)\n", __func__, display->info->var.rotate);
-//	switch (display->info->var.rotate) {
-//	}
-//
-	return 0;
+	struct lcdreg *par = display->lcdreg;
+
+	pr_debug("%s(on=%u)\n", __func__, on);
+
+	/* V-blank only */
+	if (on)
+		return lcdreg_writereg(par, SSD1963_SET_TEAR_ON, 0x00);
+
+	return lcdreg_writereg(par, SSD1963_SET_TEAR_OFF);
 }
 
+static int ssd1963_scroll(struct fbdbi_display *display, unsigned area,
+			  unsigned line)
+{
+	struct lcdreg *par = display->lcdreg;
+	int ret;
+
+	pr_debug("%s(area=%u, line=%u)\n", __func__, area, line);
 
+	ret = lcdreg_writereg(par, SSD1963_SET_SCROLL_AREA, 0x00, 0x00,
+			      (area >> 8) & 0xFF, area & 0xFF, 0x00, 0x00);
+	ret |= lcdreg_writereg(par, SSD1963_SET_SCROLL_START,
+			       (line >> 8) & 0xFF, line & 0xFF);
+
+	return ret;
+}
 
 static const struct fbdbi_display ssd1963 = {
 	.xres = 480,
 	.yres = 800,
 	.update = ssd1963_update,
-	.rotate = ssd1963_rotate,
+	.sw_rotate = true,
+	.set_tear = ssd1963_set_tear,
+	.scroll = ssd1963_scroll,
 };
 
 